@@ -1,13 +1,25 @@
 #include "arrow.h"
+#include "renderbatch.h"
+#include "hittest.h"
 #include <QDebug>
 
 Arrow::Arrow(CompositeElement* source, CompositeElement* target, bool bidirectional)
-    : source_(source), target_(target), selected_(false), bidirectional_(bidirectional) {
+    : CompositeElement(ShapeKind::Arrow), source_(source), target_(target), selected_(false), bidirectional_(bidirectional) {
+
+    updateStyle();
+    updateGeometry();
+
+    if (source_) source_->addObserver(this);
+    if (target_) target_->addObserver(this);
 
     qDebug() << "Arrow created from" << source << "to" << target;
 }
 
 Arrow::~Arrow() {
+    // Концы стрелки удаляются только после нее самой
+    if (source_) source_->removeObserver(this);
+    if (target_) target_->removeObserver(this);
+
     qDebug() << "Arrow destroyed";
 }
 
@@ -19,47 +31,45 @@ void Arrow::draw(QPainter &painter) const {
 
     // Проверяем, что объекты все еще существуют (можно добавить проверку через контейнер)
 
-    QPoint sourceCenter = getSourceCenter();
-    QPoint targetCenter = getTargetCenter();
-
     painter.save();
 
-    if (selected_) {
-        painter.setPen(QPen(Qt::blue, 3, Qt::DashLine));
-        painter.setBrush(Qt::blue);
-    } else {
-        painter.setPen(QPen(Qt::darkGreen, 2));
-        painter.setBrush(Qt::darkGreen);
+    painter.setPen(pen_);
+    painter.setBrush(brush_);
+
+    painter.drawLine(line_);
+    painter.drawPolygon(targetHead_);
+
+    if (bidirectional_) {
+        painter.drawPolygon(sourceHead_);
     }
 
-    painter.drawLine(sourceCenter, targetCenter);
+    painter.restore();
+}
+
+void Arrow::addToBatch(RenderBatch &batch) const {
+    if (!source_ || !target_) return;
 
-    drawArrowHead(painter, sourceCenter, targetCenter);
+    batch.addLine(line_, pen_);
+    batch.addPolygon(targetHead_, pen_, brush_);
 
     if (bidirectional_) {
-        drawArrowHead(painter, targetCenter, sourceCenter);
+        batch.addPolygon(sourceHead_, pen_, brush_);
     }
+}
 
-    painter.restore();
+void Arrow::addToHitTest(HitTestBatch &batch, int id) const {
+    if (!source_ || !target_ || line_.p1() == line_.p2()) return;
+    batch.addCapsule(id, line_.x1(), line_.y1(), line_.x2(), line_.y2(), HIT_DISTANCE);
 }
 
 bool Arrow::contains(int x, int y) const {
     if (!source_ || !target_) return false;
-    return isPointNearLine(x, y, 5);
+    return isPointNearLine(x, y, HIT_DISTANCE);
 }
 
 QRect Arrow::getBorderRect() const {
     if (!source_ || !target_) return QRect(0, 0, 0, 0);
-
-    QPoint sourceCenter = getSourceCenter();
-    QPoint targetCenter = getTargetCenter();
-
-    int left = std::min(sourceCenter.x(), targetCenter.x());
-    int right = std::max(sourceCenter.x(), targetCenter.x());
-    int top = std::min(sourceCenter.y(), targetCenter.y());
-    int bottom = std::max(sourceCenter.y(), targetCenter.y());
-
-    return QRect(left - 5, top - 5, right - left + 10, bottom - top + 10);
+    return bounds_;
 }
 
 QRect Arrow::getSafeBorderRect(int margin) const {
@@ -88,7 +98,9 @@ bool Arrow::getSelected() const {
 }
 
 void Arrow::setSelected(bool selected) {
+    if (selected_ == selected) return;
     selected_ = selected;
+    updateStyle();
 }
 
 QColor Arrow::getColor() const {
@@ -101,12 +113,12 @@ void Arrow::setColor(const QColor& color) {
 
 int Arrow::getX() const {
     if (!source_) return 0;
-    return getSourceCenter().x();
+    return line_.p1().x();
 }
 
 int Arrow::getY() const {
     if (!source_) return 0;
-    return getSourceCenter().y();
+    return line_.p1().y();
 }
 
 void Arrow::setPosition(int x, int y) {
@@ -122,8 +134,11 @@ const std::vector<CompositeElement*>& Arrow::getChildren() const {
     return empty;
 }
 
-void Arrow::update(const std::string& eventType, void* data) {
-    // ничего не делаем
+void Arrow::update(const Event& event) {
+    if (event.kind == EventKind::GeometryChanged &&
+        (event.element == source_ || event.element == target_)) {
+        updateGeometry();
+    }
 }
 
 std::string Arrow::save() const {
@@ -146,6 +161,7 @@ void Arrow::load(const std::string& data) {
 
     bidirectional_ = (bidir != 0);
     selected_ = (selected != 0);
+    updateStyle();
 }
 
 QPoint Arrow::getSourceCenter() const {
@@ -160,7 +176,40 @@ QPoint Arrow::getTargetCenter() const {
     return bounds.center();
 }
 
-void Arrow::drawArrowHead(QPainter& painter, const QPoint& from, const QPoint& to) const {
+void Arrow::updateGeometry() {
+    if (!source_ || !target_) return;
+
+    QPoint sourceCenter = getSourceCenter();
+    QPoint targetCenter = getTargetCenter();
+    line_ = QLine(sourceCenter, targetCenter);
+
+    int left = std::min(sourceCenter.x(), targetCenter.x());
+    int right = std::max(sourceCenter.x(), targetCenter.x());
+    int top = std::min(sourceCenter.y(), targetCenter.y());
+    int bottom = std::max(sourceCenter.y(), targetCenter.y());
+    bounds_ = QRect(left - 5, top - 5, right - left + 10, bottom - top + 10);
+
+    targetHead_ = arrowHead(sourceCenter, targetCenter);
+    sourceHead_ = bidirectional_ ? arrowHead(targetCenter, sourceCenter) : QPolygon();
+}
+
+void Arrow::updateStyle() {
+    pen_ = linePen();
+    brush_ = headBrush();
+}
+
+QPen Arrow::linePen() const {
+    if (selected_) {
+        return QPen(Qt::blue, 3, Qt::DashLine);
+    }
+    return QPen(Qt::darkGreen, 2);
+}
+
+QBrush Arrow::headBrush() const {
+    return selected_ ? QBrush(Qt::blue) : QBrush(Qt::darkGreen);
+}
+
+QPolygon Arrow::arrowHead(const QPoint& from, const QPoint& to) const {
     const int arrowSize = 10;
 
     double angle = std::atan2(to.y() - from.y(), to.x() - from.x());
@@ -173,29 +222,17 @@ void Arrow::drawArrowHead(QPainter& painter, const QPoint& from, const QPoint& t
     QPolygon arrowHead;
     arrowHead << to << arrowP1 << arrowP2;
 
-    painter.drawPolygon(arrowHead);
+    return arrowHead;
 }
 
 bool Arrow::isPointNearLine(int px, int py, int threshold) const {
     if (!source_ || !target_) return false;
 
-    QPoint p1 = getSourceCenter();
-    QPoint p2 = getTargetCenter();
-
-    double dx = p2.x() - p1.x();
-    double dy = p2.y() - p1.y();
-
-    if (dx == 0 && dy == 0) return false;
-
-    double t = ((px - p1.x()) * dx + (py - p1.y()) * dy) / (dx*dx + dy*dy);
-
-    if (t < 0) t = 0;
-    if (t > 1) t = 1;
-
-    double projX = p1.x() + t * dx;
-    double projY = p1.y() + t * dy;
+    QPoint p1 = line_.p1();
+    QPoint p2 = line_.p2();
 
-    double dist = std::sqrt((px - projX)*(px - projX) + (py - projY)*(py - projY));
+    if (p1 == p2) return false;
 
-    return dist <= threshold;
+    // Сравниваем квадраты расстояний, без корня
+    return HitTest::inCapsule(px, py, p1.x(), p1.y(), p2.x(), p2.y(), threshold);
 }
@@ -13,12 +13,24 @@ private:
     bool selected_;
     bool bidirectional_;
 
+    // Кэш: отрезок между центрами концов, границы, готовые наконечники, перо и кисть.
+    // Стрелка подписана на свои концы и пересчитывает геометрию только по
+    // событию EventKind::GeometryChanged, стиль - при смене выделения.
+    QLine line_;
+    QRect bounds_;
+    QPolygon targetHead_;
+    QPolygon sourceHead_;
+    QPen pen_;
+    QBrush brush_;
+
 public:
     Arrow(CompositeElement* source, CompositeElement* target, bool bidirectional = false);
     ~Arrow();
 
     // CompositeElement interface
     void draw(QPainter &painter) const override;
+    void addToBatch(RenderBatch &batch) const override;
+    void addToHitTest(HitTestBatch &batch, int id) const override;
     bool contains(int x, int y) const override;
     QRect getBorderRect() const override;
     QRect getSafeBorderRect(int margin) const override;
@@ -35,17 +47,18 @@ public:
     void setPosition(int x, int y) override;
     void setPositionRelative(int dx, int dy) override;
     const std::vector<CompositeElement*>& getChildren() const override;
-    bool isGroup() const override { return false; }
-    std::string getTypeName() const override { return "Arrow"; }
 
     // Observer interface
-    void update(const std::string& eventType, void* data) override;
+    void update(const Event& event) override;
 
     // Arrow specific
     CompositeElement* getSource() const { return source_; }
     CompositeElement* getTarget() const { return target_; }
     bool isBidirectional() const { return bidirectional_; }
 
+    // Пересчитывает кэшированную геометрию по текущему положению концов
+    void updateGeometry();
+
     // Serializable
     std::string save() const override;
     void load(const std::string& data) override;
@@ -53,8 +66,14 @@ public:
 private:
     QPoint getSourceCenter() const;
     QPoint getTargetCenter() const;
-    void drawArrowHead(QPainter& painter, const QPoint& from, const QPoint& to) const;
+    QPolygon arrowHead(const QPoint& from, const QPoint& to) const;
+    QPen linePen() const;
+    QBrush headBrush() const;
+    void updateStyle();
     bool isPointNearLine(int px, int py, int threshold) const;
+
+    // Расстояние до линии, на котором стрелка считается задетой
+    static const int HIT_DISTANCE = 5;
 };
 
 #endif // ARROW_H
@@ -0,0 +1,138 @@
+#include "boundingvolumehierarchy.h"
+#include <algorithm>
+
+void BoundingVolumeHierarchy::build(const std::vector<CompositeElement*>& elements, const std::vector<QRect>& bounds)
+{
+    clear();
+    if (elements.empty()) return;
+
+    items_.reserve(elements.size());
+    for (size_t i = 0; i < elements.size(); ++i) {
+        items_.push_back({elements[i], bounds[i], (int)i});
+    }
+
+    // В двоичном дереве с листами не меньше одного элемента узлов меньше 2n
+    nodes_.reserve(2 * items_.size());
+    buildNode(0, (int)items_.size());
+}
+
+void BoundingVolumeHierarchy::clear()
+{
+    nodes_.clear();
+    items_.clear();
+}
+
+void BoundingVolumeHierarchy::translate(int dx, int dy)
+{
+    for (Node& node : nodes_) {
+        node.bounds.translate(dx, dy);
+    }
+    for (Item& item : items_) {
+        item.bounds.translate(dx, dy);
+    }
+}
+
+int BoundingVolumeHierarchy::buildNode(int first, int count)
+{
+    QRect bounds = items_[first].bounds;
+    for (int i = first + 1; i < first + count; ++i) {
+        bounds = bounds.united(items_[i].bounds);
+    }
+
+    int index = (int)nodes_.size();
+    nodes_.push_back({bounds, -1, -1, first, count});
+    if (count <= LEAF_SIZE) {
+        return index;
+    }
+
+    // Делим по медиане центров вдоль длинной стороны узла
+    bool splitX = bounds.width() >= bounds.height();
+    int middle = first + count / 2;
+    std::nth_element(items_.begin() + first, items_.begin() + middle, items_.begin() + first + count,
+                     [splitX](const Item& a, const Item& b) {
+                         return splitX ? a.bounds.center().x() < b.bounds.center().x()
+                                       : a.bounds.center().y() < b.bounds.center().y();
+                     });
+
+    int left = buildNode(first, middle - first);
+    int right = buildNode(middle, first + count - middle);
+
+    // nodes_ мог быть перераспределен, поэтому обращаемся по индексу
+    nodes_[index].left = left;
+    nodes_[index].right = right;
+    nodes_[index].count = 0;
+    return index;
+}
+
+std::vector<CompositeElement*> BoundingVolumeHierarchy::queryPoint(int x, int y) const
+{
+    std::vector<int> hits;
+    if (nodes_.empty()) return {};
+
+    std::vector<int> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const Node& node = nodes_[stack.back()];
+        stack.pop_back();
+
+        if (!node.bounds.contains(x, y)) continue;
+
+        if (node.left < 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                if (items_[i].bounds.contains(x, y)) {
+                    hits.push_back(i);
+                }
+            }
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+
+    std::vector<CompositeElement*> result = collect(hits);
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+std::vector<CompositeElement*> BoundingVolumeHierarchy::queryRect(const QRect& rect) const
+{
+    std::vector<int> hits;
+    if (nodes_.empty()) return {};
+
+    std::vector<int> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const Node& node = nodes_[stack.back()];
+        stack.pop_back();
+
+        if (!node.bounds.intersects(rect)) continue;
+
+        if (node.left < 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                if (items_[i].bounds.intersects(rect)) {
+                    hits.push_back(i);
+                }
+            }
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+
+    return collect(hits);
+}
+
+std::vector<CompositeElement*> BoundingVolumeHierarchy::collect(std::vector<int>& hits) const
+{
+    // hits - позиции в items_; возвращаем элементы в исходном порядке
+    std::sort(hits.begin(), hits.end(), [this](int a, int b) {
+        return items_[a].order < items_[b].order;
+    });
+
+    std::vector<CompositeElement*> result;
+    result.reserve(hits.size());
+    for (int i : hits) {
+        result.push_back(items_[i].element);
+    }
+    return result;
+}
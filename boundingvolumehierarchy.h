@@ -0,0 +1,56 @@
+#ifndef BOUNDINGVOLUMEHIERARCHY_H
+#define BOUNDINGVOLUMEHIERARCHY_H
+
+#include <QRect>
+#include <vector>
+
+class CompositeElement;
+
+// Иерархия ограничивающих прямоугольников над фиксированным набором элементов
+// (детьми группы). Строится сверху вниз делением по медиане вдоль длинной
+// стороны, поэтому запрос по точке спускается только в узлы, покрывающие
+// точку. Результаты возвращаются в исходном порядке элементов (z-порядке).
+class BoundingVolumeHierarchy
+{
+public:
+    BoundingVolumeHierarchy() = default;
+
+    // bounds[i] - границы elements[i]
+    void build(const std::vector<CompositeElement*>& elements, const std::vector<QRect>& bounds);
+    void clear();
+    void translate(int dx, int dy);
+
+    bool isEmpty() const { return nodes_.empty(); }
+
+    // Элементы, чьи границы содержат точку: сверху вниз (последний первым)
+    std::vector<CompositeElement*> queryPoint(int x, int y) const;
+
+    // Элементы, чьи границы пересекают прямоугольник: в порядке отрисовки
+    std::vector<CompositeElement*> queryRect(const QRect& rect) const;
+
+private:
+    struct Node {
+        QRect bounds;
+        int left;    // Дочерние узлы, -1 у листа
+        int right;
+        int first;   // Диапазон items_ у листа
+        int count;
+    };
+
+    struct Item {
+        CompositeElement* element;
+        QRect bounds;
+        int order;   // Номер в исходном наборе
+    };
+
+    // Больше этого числа элементов лист делится на два узла
+    static const int LEAF_SIZE = 4;
+
+    std::vector<Node> nodes_;
+    std::vector<Item> items_;
+
+    int buildNode(int first, int count);
+    std::vector<CompositeElement*> collect(std::vector<int>& hits) const;
+};
+
+#endif // BOUNDINGVOLUMEHIERARCHY_H
@@ -1,26 +1,37 @@
 #include "circle.h"
+#include "renderbatch.h"
+#include "hittest.h"
 
-Circle::Circle(int x, int y, int radius) : Shape(x, y), radius_(radius) {}
+Circle::Circle(int x, int y, int radius) : Shape(x, y), radius_(radius) {
+    updateRenderCache();
+}
 
 bool Circle::contains(int x, int y) const {
-    int dx = x - x_;
-    int dy = y - y_;
-    return (dx * dx + dy * dy) <= (radius_ * radius_);
+    return HitTest::inCircle(x, y, x_, y_, radius_);
 }
 
 void Circle::draw(QPainter &painter) const {
-    if (selected_) {
-        painter.setPen(QPen(Qt::blue, 2));
-        painter.setBrush(color_.lighter(150));
-    }
-    else {
-        painter.setPen(QPen(Qt::black, 2));
-        painter.setBrush(color_);
-    }
+    painter.setPen(style_->pen);
+    painter.setBrush(style_->brush);
 
     painter.drawEllipse(x_ - radius_, y_ - radius_, 2 * radius_, 2 * radius_);
 }
 
+void Circle::addToBatch(RenderBatch &batch) const {
+    batch.addEllipse(getBorderRect(), style_->pen, style_->brush);
+}
+
+void Circle::addToHitTest(HitTestBatch &batch, int id) const {
+    batch.addCircle(id, x_, y_, radius_);
+}
+
+StyleKey Circle::styleKey(bool selected) const {
+    if (selected) {
+        return Shape::styleKey(selected);
+    }
+    return StyleKey::outline(qRgb(0, 0, 0), 2, ColorRole::Shape);
+}
+
 QRect Circle::getBorderRect() const {
     return QRect(x_ - radius_, y_ - radius_, 2 * radius_, 2 * radius_);
 }
@@ -12,11 +12,16 @@ public:
     Circle(int x, int y, int radius);
 
     void draw(QPainter &painter) const override;
+    void addToBatch(RenderBatch &batch) const override;
+    void addToHitTest(HitTestBatch &batch, int id) const override;
     bool contains(int x, int y) const override;
     QRect getBorderRect() const override;
 
     int getRadius() const;
     void setRadius(int r);
+
+protected:
+    StyleKey styleKey(bool selected) const override;
 };
 
 #endif // CIRCLE_H
@@ -1,54 +1,155 @@
 #include "composite.h"
-#include "circle.h"
-#include "rectangle.h"
-#include "square.h"
-#include "triangle.h"
-#include "line.h"
 #include <sstream>
 #include <iostream>
 
-std::string ShapeAdapter::getTypeName() const
+// Вызов метода у фигуры конкретного типа: s.T::method() не проходит через vtable
+#define SHAPE_VISIT(expr) std::visit([&](auto& s) { using T = std::decay_t<decltype(s)>; return expr; }, shape_)
+
+void ShapeAdapter::draw(QPainter &painter) const
+{
+    SHAPE_VISIT(s.T::draw(painter));
+}
+
+void ShapeAdapter::addToBatch(RenderBatch &batch) const
+{
+    SHAPE_VISIT(s.T::addToBatch(batch));
+}
+
+void ShapeAdapter::addToHitTest(HitTestBatch &batch, int id) const
+{
+    SHAPE_VISIT(s.T::addToHitTest(batch, id));
+}
+
+bool ShapeAdapter::contains(int x, int y) const
+{
+    return SHAPE_VISIT(s.T::contains(x, y));
+}
+
+QRect ShapeAdapter::getBorderRect() const
+{
+    return SHAPE_VISIT(s.T::getBorderRect());
+}
+
+QRect ShapeAdapter::getSafeBorderRect(int margin) const
 {
-    if (dynamic_cast<Circle*>(shape_)) return "Circle";
-    if (dynamic_cast<Rectangle*>(shape_)) return "Rectangle";
-    if (dynamic_cast<Square*>(shape_)) return "Square";
-    if (dynamic_cast<Triangle*>(shape_)) return "Triangle";
-    if (dynamic_cast<Line*>(shape_)) return "Line";
-    return "Unknown";
+    return SHAPE_VISIT(s.T::getSafeBorderRect(margin));
+}
+
+void ShapeAdapter::move(int dx, int dy)
+{
+    SHAPE_VISIT(s.T::move(dx, dy));
+    notifyGeometryChanged();
+}
+
+bool ShapeAdapter::checkBounds(int left, int top, int right, int bottom) const
+{
+    return SHAPE_VISIT(s.T::checkBounds(left, top, right, bottom));
+}
+
+bool ShapeAdapter::safeMove(int dx, int dy, int left, int top, int right, int bottom)
+{
+    bool moved = SHAPE_VISIT(s.T::safeMove(dx, dy, left, top, right, bottom));
+    if (moved) notifyGeometryChanged();
+    return moved;
+}
+
+bool ShapeAdapter::canChangeSize(int left, int top, int right, int bottom, int margin) const
+{
+    return SHAPE_VISIT(s.T::canChangeSize(left, top, right, bottom, margin));
+}
+
+bool ShapeAdapter::getSelected() const
+{
+    return SHAPE_VISIT(s.T::getSelected());
+}
+
+void ShapeAdapter::setSelected(bool selected)
+{
+    SHAPE_VISIT(s.T::setSelected(selected));
+}
+
+QColor ShapeAdapter::getColor() const
+{
+    return SHAPE_VISIT(s.T::getColor());
+}
+
+void ShapeAdapter::setColor(const QColor& color)
+{
+    SHAPE_VISIT(s.T::setColor(color));
+}
+
+void ShapeAdapter::adoptPalette(StylePalette& palette)
+{
+    SHAPE_VISIT(s.T::adoptPalette(palette));
+}
+
+int ShapeAdapter::getX() const
+{
+    return SHAPE_VISIT(s.T::getX());
+}
+
+int ShapeAdapter::getY() const
+{
+    return SHAPE_VISIT(s.T::getY());
+}
+
+void ShapeAdapter::setPosition(int x, int y)
+{
+    SHAPE_VISIT(s.T::setPosition(x, y));
+    notifyGeometryChanged();
+}
+
+Shape* ShapeAdapter::getShape()
+{
+    return SHAPE_VISIT(static_cast<Shape*>(&s));
+}
+
+const Shape* ShapeAdapter::getShape() const
+{
+    return SHAPE_VISIT(static_cast<const Shape*>(&s));
 }
 
 // Методы сохранения/загрузки для ShapeAdapter
 std::string ShapeAdapter::save() const
 {
+    const Shape* shape = getShape();
     std::ostringstream oss;
 
     // Сохраняем тип
     oss << getTypeName() << " ";
 
     // Сохраняем основные свойства
-    oss << shape_->getX() << " "
-        << shape_->getY() << " "
-        << shape_->getColor().red() << " "
-        << shape_->getColor().green() << " "
-        << shape_->getColor().blue() << " "
-        << shape_->getColor().alpha() << " "
-        << (shape_->getSelected() ? "1" : "0") << " ";
+    oss << shape->getX() << " "
+        << shape->getY() << " "
+        << shape->getColor().red() << " "
+        << shape->getColor().green() << " "
+        << shape->getColor().blue() << " "
+        << shape->getColor().alpha() << " "
+        << (shape->getSelected() ? "1" : "0") << " ";
 
     // Сохраняем специфичные для фигуры данные
-    if (Circle* circle = dynamic_cast<Circle*>(shape_)) {
-        oss << circle->getRadius();
-    }
-    else if (Rectangle* rect = dynamic_cast<Rectangle*>(shape_)) {
-        oss << rect->getWidth() << " " << rect->getHeight();
-    }
-    else if (Square* square = dynamic_cast<Square*>(shape_)) {
-        oss << square->getSide();
+    switch (kind()) {
+    case ShapeKind::Circle:
+        oss << std::get<Circle>(shape_).getRadius();
+        break;
+    case ShapeKind::Rectangle: {
+        const Rectangle& rect = std::get<Rectangle>(shape_);
+        oss << rect.getWidth() << " " << rect.getHeight();
+        break;
     }
-    else if (Triangle* triangle = dynamic_cast<Triangle*>(shape_)) {
-        oss << triangle->getSize();
+    case ShapeKind::Square:
+        oss << std::get<Square>(shape_).getSide();
+        break;
+    case ShapeKind::Triangle:
+        oss << std::get<Triangle>(shape_).getSize();
+        break;
+    case ShapeKind::Line: {
+        const Line& line = std::get<Line>(shape_);
+        oss << line.getX2() << " " << line.getY2() << " " << line.getThickness();
+        break;
     }
-    else if (Line* line = dynamic_cast<Line*>(shape_)) {
-        oss << line->getX2() << " " << line->getY2() << " " << line->getThickness();
+    default:
+        break;
     }
 
     return oss.str();
@@ -67,40 +168,51 @@ void ShapeAdapter::load(const std::string& data)
 
     QColor color(r, g, b, a);
 
-    // Удаляем старую фигуру
-    delete shape_;
+    // Заменяем фигуру новой в зависимости от типа
+    ShapeKind kind;
+    if (!shapeKindFromName(type, kind)) {
+        kind = ShapeKind::Group;  // Неизвестный тип: фигура остается прежней
+    }
 
-    // Создаем новую фигуру в зависимости от типа
-    if (type == "Circle") {
+    switch (kind) {
+    case ShapeKind::Circle: {
         int radius;
         iss >> radius;
-        shape_ = new Circle(x, y, radius);
+        shape_ = Circle(x, y, radius);
+        break;
     }
-    else if (type == "Rectangle") {
+    case ShapeKind::Rectangle: {
         int width, height;
         iss >> width >> height;
-        shape_ = new Rectangle(x, y, width, height);
+        shape_ = Rectangle(x, y, width, height);
+        break;
     }
-    else if (type == "Square") {
+    case ShapeKind::Square: {
         int size;
         iss >> size;
-        shape_ = new Square(x, y, size);
+        shape_ = Square(x, y, size);
+        break;
     }
-    else if (type == "Triangle") {
+    case ShapeKind::Triangle: {
         int size;
         iss >> size;
-        shape_ = new Triangle(x, y, size);
+        shape_ = Triangle(x, y, size);
+        break;
     }
-    else if (type == "Line") {
+    case ShapeKind::Line: {
         int x2, y2, thickness;
         iss >> x2 >> y2 >> thickness;
-        shape_ = new Line(x, y, x2, y2, thickness);
+        shape_ = Line(x, y, x2, y2, thickness);
+        break;
     }
-
-    if (shape_) {
-        shape_->setColor(color);
-        shape_->setSelected(selected);
+    default:
+        break;
     }
+    setKind(static_cast<ShapeKind>(shape_.index()));
+
+    setColor(color);
+    setSelected(selected);
+    notifyGeometryChanged();
 }
 
 // Методы для сохранения/загрузки детей (для групп)
@@ -2,17 +2,56 @@
 #define COMPOSITE_H
 
 #include "shape.h"
+#include "circle.h"
+#include "rectangle.h"
+#include "square.h"
+#include "triangle.h"
+#include "line.h"
 #include "serializable.h"
+#include "observer.h"
+#include "shapekind.h"
+#include "documentarena.h"
 #include <vector>
 #include <memory>
+#include <variant>
 
-// Базовый класс для элементов композиции
-class CompositeElement : public Serializable
+// Базовый класс для элементов композиции.
+// Элемент сообщает подписчикам (например, стрелкам) об изменении своей
+// геометрии событием EventKind::GeometryChanged с указателем на себя.
+class CompositeElement : public Serializable, public Observable
 {
+private:
+    CompositeElement* parent_ = nullptr;  // Группа, в которую входит элемент
+    ShapeKind kind_;                      // Конкретный тип элемента
+
+protected:
+    explicit CompositeElement(ShapeKind kind) : kind_(kind) {}
+    void setKind(ShapeKind kind) { kind_ = kind; }
+
 public:
     virtual ~CompositeElement() = default;
 
+    // Элементы, созданные внутри DocumentArena::Scope, размещаются в арене документа
+    static void* operator new(size_t size) { return DocumentArena::allocate(size); }
+    static void operator delete(void* ptr) noexcept { DocumentArena::deallocate(ptr); }
+
+    ShapeKind kind() const { return kind_; }
+
+    CompositeElement* getParent() const { return parent_; }
+    void setParent(CompositeElement* parent) { parent_ = parent; }
+
+    // Сбрасывает кэш границ у всех групп-предков
+    virtual void invalidateBounds() { if (parent_) parent_->invalidateBounds(); }
+
+    void notifyGeometryChanged() {
+        invalidateBounds();
+        notifyObservers(Event{EventKind::GeometryChanged, this});
+    }
+
     virtual void draw(QPainter &painter) const = 0;
+    virtual void addToBatch(RenderBatch &batch) const = 0;
+    // Примитивы элемента для пакетной проверки попадания, все с одним id
+    virtual void addToHitTest(HitTestBatch &batch, int id) const = 0;
     virtual bool contains(int x, int y) const = 0;
     virtual QRect getBorderRect() const = 0;
     virtual QRect getSafeBorderRect(int margin = 0) const = 0;
@@ -28,6 +67,8 @@ public:
 
     virtual QColor getColor() const = 0;
     virtual void setColor(const QColor& color) = 0;
+    // Переводит фигуры элемента на палитру документа, в который он добавлен
+    virtual void adoptPalette(StylePalette& palette) { Q_UNUSED(palette); }
 
     virtual int getX() const = 0;
     virtual int getY() const = 0;
@@ -39,10 +80,10 @@ public:
     virtual void addChild(CompositeElement* child) { Q_UNUSED(child); }
     virtual void removeChild(CompositeElement* child) { Q_UNUSED(child); }
     virtual const std::vector<CompositeElement*>& getChildren() const = 0;
-    virtual bool isGroup() const { return false; }
+    bool isGroup() const { return kind_ == ShapeKind::Group; }
 
-    // Методы для сохранения/загрузки (будем добавлять позже)
-    virtual std::string getTypeName() const = 0;
+    // Имя типа для сохранения берется из таблицы по тегу
+    std::string getTypeName() const override { return shapeKindName(kind_); }
 
     // В класс CompositeElement добавляем:
     virtual void scale(double factor) { Q_UNUSED(factor); }
@@ -59,53 +100,74 @@ public:
     virtual void loadChildren(std::istream& is);
 };
 
-// Класс-адаптер для существующих Shape
+// Фигура-лист, хранимая по значению внутри ShapeAdapter
+typedef std::variant<Circle, Rectangle, Square, Triangle, Line> LeafShape;
+
+// Тег листа по типу фигуры: индекс типа в LeafShape
+template <typename T, size_t I = 0>
+constexpr ShapeKind leafKind()
+{
+    if constexpr (std::is_same_v<std::variant_alternative_t<I, LeafShape>, T>) {
+        return static_cast<ShapeKind>(I);
+    } else {
+        return leafKind<T, I + 1>();
+    }
+}
+
+static_assert(leafKind<Circle>() == ShapeKind::Circle && leafKind<Rectangle>() == ShapeKind::Rectangle &&
+              leafKind<Square>() == ShapeKind::Square && leafKind<Triangle>() == ShapeKind::Triangle &&
+              leafKind<Line>() == ShapeKind::Line,
+              "LeafShape order must match ShapeKind");
+
+// Лист композиции: фигура хранится прямо в адаптере (одно выделение памяти
+// на лист), а методы вызываются через std::visit у конкретного типа фигуры,
+// без второго виртуального перехода и без dynamic_cast
 class ShapeAdapter : public CompositeElement
 {
 private:
-    Shape* shape_;
+    LeafShape shape_;
 
 public:
-    explicit ShapeAdapter(Shape* shape) : shape_(shape) {}
-    ~ShapeAdapter() { delete shape_; }
+    template <typename T>
+    explicit ShapeAdapter(const T& shape)
+        : CompositeElement(leafKind<T>()), shape_(shape) {}
 
-    void draw(QPainter &painter) const override { shape_->draw(painter); }
-    bool contains(int x, int y) const override { return shape_->contains(x, y); }
-    QRect getBorderRect() const override { return shape_->getBorderRect(); }
-    QRect getSafeBorderRect(int margin = 0) const override { return shape_->getSafeBorderRect(margin); }
+    void draw(QPainter &painter) const override;
+    void addToBatch(RenderBatch &batch) const override;
+    void addToHitTest(HitTestBatch &batch, int id) const override;
+    bool contains(int x, int y) const override;
+    QRect getBorderRect() const override;
+    QRect getSafeBorderRect(int margin = 0) const override;
 
-    void move(int dx, int dy) override { shape_->move(dx, dy); }
-    bool checkBounds(int left, int top, int right, int bottom) const override {
-        return shape_->checkBounds(left, top, right, bottom);
-    }
-    bool safeMove(int dx, int dy, int left, int top, int right, int bottom) override {
-        return shape_->safeMove(dx, dy, left, top, right, bottom);
-    }
+    void move(int dx, int dy) override;
+    bool checkBounds(int left, int top, int right, int bottom) const override;
+    bool safeMove(int dx, int dy, int left, int top, int right, int bottom) override;
 
-    bool canChangeSize(int left, int top, int right, int bottom, int margin = 0) const override {
-        return shape_->canChangeSize(left, top, right, bottom, margin);
-    }
+    bool canChangeSize(int left, int top, int right, int bottom, int margin = 0) const override;
 
-    bool getSelected() const override { return shape_->getSelected(); }
-    void setSelected(bool selected) override { shape_->setSelected(selected); }
+    bool getSelected() const override;
+    void setSelected(bool selected) override;
 
-    QColor getColor() const override { return shape_->getColor(); }
-    void setColor(const QColor& color) override { shape_->setColor(color); }
+    QColor getColor() const override;
+    void setColor(const QColor& color) override;
+    void adoptPalette(StylePalette& palette) override;
 
-    int getX() const override { return shape_->getX(); }
-    int getY() const override { return shape_->getY(); }
-    void setPosition(int x, int y) override { shape_->setPosition(x, y); }
+    int getX() const override;
+    int getY() const override;
+    void setPosition(int x, int y) override;
 
-    void setPositionRelative(int dx, int dy) override { shape_->move(dx, dy); }
+    void setPositionRelative(int dx, int dy) override { move(dx, dy); }
 
     const std::vector<CompositeElement*>& getChildren() const override {
         static const std::vector<CompositeElement*> empty;
         return empty;
     }
 
-    Shape* getShape() const { return shape_; }
-
-    std::string getTypeName() const override;
+    Shape* getShape();
+    const Shape* getShape() const;
+    // Тип фигуры совпадает с kind(), поэтому std::get по тегу не промахивается
+    LeafShape& getLeaf() { return shape_; }
+    const LeafShape& getLeaf() const { return shape_; }
 
     // В класс ShapeAdapter добавляем:
     void scale(double factor) override {
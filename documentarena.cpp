@@ -0,0 +1,60 @@
+#include "documentarena.h"
+#include <new>
+#include <QtGlobal>
+
+namespace {
+
+// Заголовок перед каждым объектом; выровнен так же, как память из operator new
+struct alignas(std::max_align_t) BlockHeader {
+    DocumentArena* arena;
+};
+
+}
+
+thread_local DocumentArena* DocumentArena::current_ = nullptr;
+
+DocumentArena::DocumentArena()
+    : resource_(INITIAL_BUFFER_SIZE), liveCount_(0) {}
+
+DocumentArena::~DocumentArena()
+{
+    // Живой объект удалил бы себя через заголовок с указателем на эту арену
+    Q_ASSERT(liveCount_ == 0);
+}
+
+void DocumentArena::release()
+{
+    Q_ASSERT(liveCount_ == 0);
+    resource_.release();
+}
+
+void* DocumentArena::allocate(std::size_t size)
+{
+    DocumentArena* arena = current_;
+    std::size_t total = sizeof(BlockHeader) + size;
+
+    void* block;
+    if (arena) {
+        block = arena->resource_.allocate(total, alignof(BlockHeader));
+        ++arena->liveCount_;
+    } else {
+        block = ::operator new(total);
+    }
+
+    BlockHeader* header = static_cast<BlockHeader*>(block);
+    header->arena = arena;
+    return header + 1;
+}
+
+void DocumentArena::deallocate(void* ptr) noexcept
+{
+    if (!ptr) return;
+
+    BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+    if (header->arena) {
+        // Память вернется вместе со всей ареной
+        --header->arena->liveCount_;
+    } else {
+        ::operator delete(header);
+    }
+}
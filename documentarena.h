@@ -0,0 +1,66 @@
+#ifndef DOCUMENTARENA_H
+#define DOCUMENTARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+// Арена документа: память под элементы и стрелки, созданные при загрузке.
+// Объекты выделяются подряд из монотонного буфера в порядке документа,
+// удаление отдельного объекта только уменьшает счетчик живых объектов, а
+// вся память освобождается разом через release(), когда живых не осталось.
+//
+// Арена выбирается через Scope: пока он жив, operator new элементов в этом
+// потоке берет память из арены. Вне Scope элементы создаются в куче как
+// обычно. Каждый блок начинается с заголовка с указателем на арену (или
+// nullptr для кучи), поэтому operator delete сам знает, откуда объект.
+//
+// Арена не потокобезопасна: счетчик живых объектов и буфер меняются без
+// синхронизации, поэтому одну арену нельзя делить между потоками. Каждый
+// документ (в том числе в пуле потоков laba6-render) владеет своей ареной,
+// и его объекты создаются и удаляются в одном потоке.
+class DocumentArena
+{
+public:
+    DocumentArena();
+    ~DocumentArena();
+
+    DocumentArena(const DocumentArena&) = delete;
+    DocumentArena& operator=(const DocumentArena&) = delete;
+
+    int liveCount() const { return liveCount_; }
+
+    // Возвращает всю память арены. Вызывать только без живых объектов:
+    // проверку liveCount() делает вызывающий
+    void release();
+
+    // Арена, из которой сейчас выделяются элементы в этом потоке
+    static DocumentArena* current() { return current_; }
+
+    class Scope
+    {
+    public:
+        explicit Scope(DocumentArena* arena) : previous_(current_) { current_ = arena; }
+        ~Scope() { current_ = previous_; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        DocumentArena* previous_;
+    };
+
+    // Выделение и освобождение памяти под элементы (для operator new/delete)
+    static void* allocate(std::size_t size);
+    static void deallocate(void* ptr) noexcept;
+
+private:
+    // Размер первого буфера; следующие растут геометрически
+    static const std::size_t INITIAL_BUFFER_SIZE = 64 * 1024;
+
+    std::pmr::monotonic_buffer_resource resource_;
+    int liveCount_;
+
+    static thread_local DocumentArena* current_;
+};
+
+#endif // DOCUMENTARENA_H
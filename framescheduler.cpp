@@ -0,0 +1,58 @@
+#include "framescheduler.h"
+#include <QGuiApplication>
+#include <QScreen>
+#include <QtMath>
+#include <algorithm>
+
+FrameScheduler::FrameScheduler(QObject* parent)
+    : QObject(parent), interval_(16), pendingDx_(0), pendingDy_(0)
+{
+    if (QScreen* screen = QGuiApplication::primaryScreen()) {
+        if (screen->refreshRate() > 0) {
+            interval_ = std::max(1, qRound(1000.0 / screen->refreshRate()));
+        }
+    }
+
+    timer_.setSingleShot(true);
+    timer_.setTimerType(Qt::PreciseTimer);
+    connect(&timer_, &QTimer::timeout, this, &FrameScheduler::onTimeout);
+}
+
+void FrameScheduler::setInterval(int interval)
+{
+    interval_ = std::max(1, interval);
+}
+
+void FrameScheduler::requestFrame()
+{
+    if (timer_.isActive()) return;
+
+    // После простоя кадр идет сразу (на следующей итерации цикла событий),
+    // иначе - не раньше, чем через период после предыдущего
+    int wait = 0;
+    if (sinceFrame_.isValid()) {
+        wait = std::max<qint64>(0, interval_ - sinceFrame_.elapsed());
+    }
+    timer_.start(wait);
+}
+
+void FrameScheduler::addMove(int dx, int dy)
+{
+    pendingDx_ += dx;
+    pendingDy_ += dy;
+    requestFrame();
+}
+
+QPoint FrameScheduler::takeMove()
+{
+    QPoint move(pendingDx_, pendingDy_);
+    pendingDx_ = 0;
+    pendingDy_ = 0;
+    return move;
+}
+
+void FrameScheduler::onTimeout()
+{
+    sinceFrame_.start();
+    emit frame();
+}
@@ -0,0 +1,48 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QPoint>
+
+// Планировщик кадров окна. Обработчики ввода не перерисовывают сразу, а
+// накапливают работу (смещение выделения) и запрашивают кадр. Сигнал frame
+// приходит не чаще одного раза за период обновления экрана, и обработчик
+// кадра применяет все накопленное одним проходом: автоповтор клавиш и
+// быстрые щелчки не выстраиваются в очередь перерисовок.
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FrameScheduler(QObject* parent = nullptr);
+
+    // Период кадра в мс; по умолчанию по частоте обновления основного экрана
+    int interval() const { return interval_; }
+    void setInterval(int interval);
+
+    // Запрашивает кадр; повторные запросы до его начала объединяются
+    void requestFrame();
+    bool isFramePending() const { return timer_.isActive(); }
+
+    // Добавляет смещение выделения к накопленному за кадр и запрашивает кадр
+    void addMove(int dx, int dy);
+    // Возвращает накопленное смещение и обнуляет его
+    QPoint takeMove();
+
+signals:
+    void frame();
+
+private slots:
+    void onTimeout();
+
+private:
+    QTimer timer_;
+    QElapsedTimer sinceFrame_;  // Время с начала предыдущего кадра
+    int interval_;
+    int pendingDx_;
+    int pendingDy_;
+};
+
+#endif // FRAMESCHEDULER_H
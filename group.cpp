@@ -1,10 +1,11 @@
 #include "group.h"
 #include "shapefactory.h"
+#include "renderbatch.h"
 #include <QPainter>
 #include <algorithm>
 #include <sstream>
 
-Group::Group() : selected_(false), color_(Qt::gray) {}
+Group::Group() : CompositeElement(ShapeKind::Group), selected_(false), color_(QColor(Qt::gray).rgba()), boundsDirty_(true), hierarchyDirty_(true), subtreePrepared_(false) {}
 
 Group::~Group()
 {
@@ -43,24 +44,124 @@ void Group::draw(QPainter &painter) const
     }
 }
 
+void Group::addToBatch(RenderBatch &batch) const
+{
+    // Если группа видна не целиком, видимых детей выбирает иерархия границ
+    const QRect& cull = batch.cullRect();
+    if (cull.isNull() || cull.contains(getBorderRect())) {
+        for (auto child : children_) {
+            child->addToBatch(batch);
+        }
+    } else {
+        for (auto child : findChildrenInRect(cull)) {
+            child->addToBatch(batch);
+        }
+    }
+
+    // Рамка выделения идет после детей, как и в draw
+    if (selected_) {
+        QPen pen(Qt::blue, 2, Qt::DashLine);
+        QRect bounds = getBorderRect();
+        batch.addRect(bounds, pen, Qt::NoBrush);
+
+        int markerSize = 6;
+        batch.addRect(QRect(bounds.left() - markerSize/2, bounds.top() - markerSize/2, markerSize, markerSize), pen, Qt::blue);
+        batch.addRect(QRect(bounds.right() - markerSize/2, bounds.top() - markerSize/2, markerSize, markerSize), pen, Qt::blue);
+        batch.addRect(QRect(bounds.left() - markerSize/2, bounds.bottom() - markerSize/2, markerSize, markerSize), pen, Qt::blue);
+        batch.addRect(QRect(bounds.right() - markerSize/2, bounds.bottom() - markerSize/2, markerSize, markerSize), pen, Qt::blue);
+    }
+}
+
+void Group::addToHitTest(HitTestBatch &batch, int id) const
+{
+    // Группа задета, если задет любой из ее детей. Контейнер группы в пакет
+    // не добавляет (проверяет через contains), это общий путь для прочих пакетов
+    for (auto child : children_) {
+        child->addToHitTest(batch, id);
+    }
+}
+
 bool Group::contains(int x, int y) const
 {
-    // Проверяем, попадает ли точка в границы группы
-    return getBorderRect().contains(x, y);
+    // Точка должна попасть в одного из детей, а не просто в общие границы
+    if (!getSafeBorderRect(HIT_MARGIN).contains(x, y)) {
+        return false;
+    }
+    return childAt(x, y) != nullptr;
+}
+
+CompositeElement* Group::childAt(int x, int y) const
+{
+    for (CompositeElement* child : hierarchy().queryPoint(x, y)) {
+        if (child->contains(x, y)) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<CompositeElement*> Group::findChildrenInRect(const QRect& rect) const
+{
+    return hierarchy().queryRect(rect);
+}
+
+void Group::prepareHierarchy() const
+{
+    // Сброс у вложенной группы сбрасывает флаг и у предков, поэтому готовое
+    // поддерево означает, что готовы и все вложенные группы
+    if (subtreePrepared_) return;
+
+    hierarchy();
+    getBorderRect();
+    for (auto child : children_) {
+        if (child->isGroup()) {
+            static_cast<const Group*>(child)->prepareHierarchy();
+        }
+    }
+    subtreePrepared_ = true;
+}
+
+const BoundingVolumeHierarchy& Group::hierarchy() const
+{
+    if (hierarchyDirty_) {
+        std::vector<QRect> bounds;
+        bounds.reserve(children_.size());
+        for (auto child : children_) {
+            bounds.push_back(child->getSafeBorderRect(HIT_MARGIN));
+        }
+        hierarchy_.build(children_, bounds);
+        hierarchyDirty_ = false;
+    }
+    return hierarchy_;
 }
 
 QRect Group::getBorderRect() const
 {
-    // ВСЕГДА вычисляем границы заново
-    if (children_.empty()) {
-        return QRect(0, 0, 0, 0);
+    if (!boundsDirty_) {
+        return bounds_;
     }
 
-    QRect bounds = children_[0]->getBorderRect();
-    for (size_t i = 1; i < children_.size(); ++i) {
-        bounds = bounds.united(children_[i]->getBorderRect());
+    if (children_.empty()) {
+        bounds_ = QRect(0, 0, 0, 0);
+    } else {
+        bounds_ = children_[0]->getBorderRect();
+        for (size_t i = 1; i < children_.size(); ++i) {
+            bounds_ = bounds_.united(children_[i]->getBorderRect());
+        }
     }
-    return bounds;
+    boundsDirty_ = false;
+    return bounds_;
+}
+
+void Group::invalidateBounds()
+{
+    // Если кэш уже сброшен, то сброшен и у всех предков
+    if (boundsDirty_ && hierarchyDirty_ && !subtreePrepared_) return;
+
+    boundsDirty_ = true;
+    hierarchyDirty_ = true;
+    subtreePrepared_ = false;
+    CompositeElement::invalidateBounds();
 }
 
 QRect Group::getSafeBorderRect(int margin) const
@@ -71,10 +172,31 @@ QRect Group::getSafeBorderRect(int margin) const
 
 void Group::move(int dx, int dy)
 {
+    bool wasValid = !boundsDirty_;
+    bool hierarchyWasValid = !hierarchyDirty_;
+    bool subtreeWasPrepared = subtreePrepared_;
+
     // Перемещаем всех детей
     for (auto child : children_) {
         child->move(dx, dy);
     }
+
+    // При сдвиге границы просто сдвигаются, пересчитывать их не нужно
+    if (wasValid) {
+        bounds_.translate(dx, dy);
+        boundsDirty_ = false;
+    }
+    if (hierarchyWasValid) {
+        hierarchy_.translate(dx, dy);
+        hierarchyDirty_ = false;
+    }
+    // Вложенные группы так же сохранили свои иерархии
+    subtreePrepared_ = subtreeWasPrepared;
+
+    // Уведомляем после восстановления кэша: стрелки запросят границы и
+    // получат сдвинутые, без обхода поддерева. Сбрасываются только предки.
+    CompositeElement::invalidateBounds();
+    notifyObservers(Event{EventKind::GeometryChanged, this});
 }
 
 bool Group::checkBounds(int left, int top, int right, int bottom) const
@@ -113,6 +235,7 @@ bool Group::safeMove(int dx, int dy, int left, int top, int right, int bottom)
         return false;
     }
 
+    notifyGeometryChanged();
     return true;
 }
 
@@ -129,27 +252,31 @@ bool Group::getSelected() const
 
 void Group::setSelected(bool selected)
 {
+    // Выделение группы показывает ее рамка, дети не перебираются
     selected_ = selected;
-    // Также выделяем/снимаем выделение со всех детей
-    for (auto child : children_) {
-        child->setSelected(selected);
-    }
 }
 
 QColor Group::getColor() const
 {
-    return color_;
+    return QColor::fromRgba(color_);
 }
 
 void Group::setColor(const QColor& color)
 {
-    color_ = color;
+    color_ = color.rgba();
     // Устанавливаем цвет всем детям
     for (auto child : children_) {
         child->setColor(color);
     }
 }
 
+void Group::adoptPalette(StylePalette& palette)
+{
+    for (auto child : children_) {
+        child->adoptPalette(palette);
+    }
+}
+
 int Group::getX() const
 {
     QRect bounds = getBorderRect();
@@ -178,7 +305,13 @@ void Group::setPositionRelative(int dx, int dy)
 void Group::addChild(CompositeElement* child)
 {
     if (child) {
+        // Выделяется группа целиком, а не ее дети: выделение группы их не
+        // перебирает, поэтому унаследованное (из файла или до группировки)
+        // снимается здесь, иначе ребенок навсегда остался бы выделенным
+        child->setSelected(false);
         children_.push_back(child);
+        child->setParent(this);
+        notifyGeometryChanged();
     }
 }
 
@@ -186,7 +319,9 @@ void Group::removeChild(CompositeElement* child)
 {
     auto it = std::find(children_.begin(), children_.end(), child);
     if (it != children_.end()) {
+        (*it)->setParent(nullptr);
         children_.erase(it);
+        notifyGeometryChanged();
     }
 }
 
@@ -205,10 +340,10 @@ std::string Group::save() const
 
     // Сохраняем основные свойства
     oss << (selected_ ? "1" : "0") << " "
-        << color_.red() << " "
-        << color_.green() << " "
-        << color_.blue() << " "
-        << color_.alpha() << " "
+        << qRed(color_) << " "
+        << qGreen(color_) << " "
+        << qBlue(color_) << " "
+        << qAlpha(color_) << " "
         << children_.size() << " ";  // Количество детей в конце
 
     // Сохраняем детей
@@ -230,7 +365,7 @@ void Group::load(const std::string& data)
 
     int r, g, b, a;
     iss >> r >> g >> b >> a;
-    color_ = QColor(r, g, b, a);
+    color_ = qRgba(r, g, b, a);
 
     // Очищаем текущих детей
     clearChildren();
@@ -266,8 +401,11 @@ void Group::loadChildren(std::istream& is)
             // Заменяем существующего ребенка
             delete children_[i];
             children_[i] = child;
+            child->setSelected(false);
+            child->setParent(this);
         }
     }
+    invalidateBounds();
 }
 
 void Group::clearChildren()
@@ -276,5 +414,6 @@ void Group::clearChildren()
         delete child;
     }
     children_.clear();
+    invalidateBounds();
 }
 
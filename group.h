@@ -2,6 +2,7 @@
 #define GROUP_H
 
 #include "composite.h"
+#include "boundingvolumehierarchy.h"
 #include <vector>
 #include <algorithm>
 
@@ -10,7 +11,24 @@ class Group : public CompositeElement
 private:
     std::vector<CompositeElement*> children_;
     bool selected_;
-    QColor color_; // Цвет группы (для выделения)
+    QRgb color_; // Цвет группы (для выделения) в упакованном виде
+
+    // Кэш границ. Сбрасывается при изменении детей и передается вверх по
+    // предкам (invalidateBounds), пересчитывается при следующем запросе.
+    // Контейнер запрашивает границы при каждом обновлении индекса в потоке GUI,
+    // поэтому при многопоточной отрисовке кэш уже заполнен.
+    mutable QRect bounds_;
+    mutable bool boundsDirty_;
+
+    // Иерархия границ детей для точного попадания и выборки по прямоугольнику.
+    // Перестраивается при следующем запросе после сброса кэша границ.
+    mutable BoundingVolumeHierarchy hierarchy_;
+    mutable bool hierarchyDirty_;
+    // Иерархии и границы всего поддерева построены (prepareHierarchy).
+    // Отдельно от hierarchyDirty_: точечный запрос может перестроить иерархию
+    // внешней группы, оставив вложенные сброшенными.
+    mutable bool subtreePrepared_;
+    const BoundingVolumeHierarchy& hierarchy() const;
     void clearChildren();
 
 public:
@@ -18,9 +36,12 @@ public:
     ~Group();
 
     void draw(QPainter &painter) const override;
+    void addToBatch(RenderBatch &batch) const override;
+    void addToHitTest(HitTestBatch &batch, int id) const override;
     bool contains(int x, int y) const override;
     QRect getBorderRect() const override;
     QRect getSafeBorderRect(int margin = 0) const override;
+    void invalidateBounds() override;
 
     void move(int dx, int dy) override;
     bool checkBounds(int left, int top, int right, int bottom) const override;
@@ -33,6 +54,7 @@ public:
 
     QColor getColor() const override;
     void setColor(const QColor& color) override;
+    void adoptPalette(StylePalette& palette) override;
 
     int getX() const override;
     int getY() const override;
@@ -44,14 +66,22 @@ public:
     void addChild(CompositeElement* child) override;
     void removeChild(CompositeElement* child) override;
     const std::vector<CompositeElement*>& getChildren() const override;
-    bool isGroup() const override { return true; }
+
+    // Запас вокруг границ детей, в пределах которого они принимают попадание
+    static const int HIT_MARGIN = 5;
+
+    // Верхний ребенок под точкой (с учетом формы) или nullptr
+    CompositeElement* childAt(int x, int y) const;
+    // Дети, чьи границы пересекают прямоугольник, в порядке отрисовки
+    std::vector<CompositeElement*> findChildrenInRect(const QRect& rect) const;
+    // Строит иерархии этой группы и вложенных групп заранее, в потоке GUI,
+    // чтобы потоки отрисовки по плиткам только читали их
+    void prepareHierarchy() const;
 
     // Специальные методы для Group
     bool isEmpty() const { return children_.empty(); }
     int getChildCount() const { return children_.size(); }
 
-    std::string getTypeName() const override { return "Group"; }
-
     // Методы Serializable
     std::string save() const override;
     void load(const std::string& data) override;
@@ -0,0 +1,284 @@
+#include "hittest.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Обертки над векторными регистрами: ядра ниже написаны один раз
+// и собираются для нужной ширины. Mask - результат сравнения по дорожкам.
+
+struct ScalarLanes {
+    static const int WIDTH = 1;
+    typedef float Value;
+    typedef bool Mask;
+
+    static Value load(const float* p) { return *p; }
+    static Value set(float v) { return v; }
+    static Value add(Value a, Value b) { return a + b; }
+    static Value sub(Value a, Value b) { return a - b; }
+    static Value mul(Value a, Value b) { return a * b; }
+    static Value min(Value a, Value b) { return a < b ? a : b; }
+    static Value max(Value a, Value b) { return a > b ? a : b; }
+    static Mask less(Value a, Value b) { return a < b; }
+    static Mask lessEqual(Value a, Value b) { return a <= b; }
+    static Mask both(Mask a, Mask b) { return a && b; }
+    static Mask either(Mask a, Mask b) { return a || b; }
+    static Mask firstNotSecond(Mask a, Mask b) { return !a && b; }
+    static int bits(Mask m) { return m ? 1 : 0; }
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+struct SseLanes {
+    static const int WIDTH = 4;
+    typedef __m128 Value;
+    typedef __m128 Mask;
+
+    static Value load(const float* p) { return _mm_loadu_ps(p); }
+    static Value set(float v) { return _mm_set1_ps(v); }
+    static Value add(Value a, Value b) { return _mm_add_ps(a, b); }
+    static Value sub(Value a, Value b) { return _mm_sub_ps(a, b); }
+    static Value mul(Value a, Value b) { return _mm_mul_ps(a, b); }
+    static Value min(Value a, Value b) { return _mm_min_ps(a, b); }
+    static Value max(Value a, Value b) { return _mm_max_ps(a, b); }
+    static Mask less(Value a, Value b) { return _mm_cmplt_ps(a, b); }
+    static Mask lessEqual(Value a, Value b) { return _mm_cmple_ps(a, b); }
+    static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+    static Mask either(Mask a, Mask b) { return _mm_or_ps(a, b); }
+    static Mask firstNotSecond(Mask a, Mask b) { return _mm_andnot_ps(a, b); }
+    static int bits(Mask m) { return _mm_movemask_ps(m); }
+};
+#endif
+
+#if defined(__AVX2__)
+struct AvxLanes {
+    static const int WIDTH = 8;
+    typedef __m256 Value;
+    typedef __m256 Mask;
+
+    static Value load(const float* p) { return _mm256_loadu_ps(p); }
+    static Value set(float v) { return _mm256_set1_ps(v); }
+    static Value add(Value a, Value b) { return _mm256_add_ps(a, b); }
+    static Value sub(Value a, Value b) { return _mm256_sub_ps(a, b); }
+    static Value mul(Value a, Value b) { return _mm256_mul_ps(a, b); }
+    static Value min(Value a, Value b) { return _mm256_min_ps(a, b); }
+    static Value max(Value a, Value b) { return _mm256_max_ps(a, b); }
+    static Mask less(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask lessEqual(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static Mask either(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+    static Mask firstNotSecond(Mask a, Mask b) { return _mm256_andnot_ps(a, b); }
+    static int bits(Mask m) { return _mm256_movemask_ps(m); }
+};
+typedef AvxLanes WideLanes;
+const char* const KERNEL_NAME = "AVX2";
+#elif defined(__SSE2__) || defined(_M_X64)
+typedef SseLanes WideLanes;
+const char* const KERNEL_NAME = "SSE2";
+#else
+typedef ScalarLanes WideLanes;
+const char* const KERNEL_NAME = "scalar";
+#endif
+
+// Переводит маску попаданий блока в порядковые номера примитивов
+inline void emitHits(int bits, int first, const std::vector<int>& order, std::vector<int>& out)
+{
+    for (int lane = 0; bits != 0; ++lane, bits >>= 1) {
+        if (bits & 1) {
+            out.push_back(order[first + lane]);
+        }
+    }
+}
+
+template <typename L>
+int circleBlock(const float* cx, const float* cy, const float* r2, float x, float y)
+{
+    typename L::Value dx = L::sub(L::set(x), L::load(cx));
+    typename L::Value dy = L::sub(L::set(y), L::load(cy));
+    typename L::Value d2 = L::add(L::mul(dx, dx), L::mul(dy, dy));
+    return L::bits(L::lessEqual(d2, L::load(r2)));
+}
+
+template <typename L>
+int rectBlock(const float* left, const float* top, const float* right, const float* bottom, float x, float y)
+{
+    typename L::Value px = L::set(x);
+    typename L::Value py = L::set(y);
+    typename L::Mask inside = L::both(L::lessEqual(L::load(left), px), L::lessEqual(px, L::load(right)));
+    inside = L::both(inside, L::both(L::lessEqual(L::load(top), py), L::lessEqual(py, L::load(bottom))));
+    return L::bits(inside);
+}
+
+template <typename L>
+int triangleBlock(const float* ax, const float* ay, const float* bx, const float* by,
+                  const float* cx, const float* cy, float x, float y)
+{
+    typename L::Value px = L::set(x);
+    typename L::Value py = L::set(y);
+    typename L::Value zero = L::set(0);
+    typename L::Value vax = L::load(ax), vay = L::load(ay);
+    typename L::Value vbx = L::load(bx), vby = L::load(by);
+    typename L::Value vcx = L::load(cx), vcy = L::load(cy);
+
+    // Те же векторные произведения, что и в HitTest::inTriangle
+    typename L::Value d1 = L::sub(L::mul(L::sub(vbx, vax), L::sub(py, vay)), L::mul(L::sub(vby, vay), L::sub(px, vax)));
+    typename L::Value d2 = L::sub(L::mul(L::sub(vcx, vbx), L::sub(py, vby)), L::mul(L::sub(vcy, vby), L::sub(px, vbx)));
+    typename L::Value d3 = L::sub(L::mul(L::sub(vax, vcx), L::sub(py, vcy)), L::mul(L::sub(vay, vcy), L::sub(px, vcx)));
+
+    typename L::Mask negative = L::either(L::either(L::less(d1, zero), L::less(d2, zero)), L::less(d3, zero));
+    typename L::Mask positive = L::either(L::either(L::less(zero, d1), L::less(zero, d2)), L::less(zero, d3));
+    typename L::Mask all = L::lessEqual(zero, zero);
+
+    // Попадание, если нет одновременно положительных и отрицательных знаков
+    return L::bits(L::firstNotSecond(L::both(negative, positive), all));
+}
+
+template <typename L>
+int capsuleBlock(const float* x1, const float* y1, const float* dx, const float* dy,
+                 const float* invLength2, const float* r2, float x, float y)
+{
+    typename L::Value vdx = L::load(dx);
+    typename L::Value vdy = L::load(dy);
+    typename L::Value ox = L::sub(L::set(x), L::load(x1));
+    typename L::Value oy = L::sub(L::set(y), L::load(y1));
+
+    // Проекция на отрезок, ограниченная его концами; у вырожденного отрезка 1/|d|^2 = 0
+    typename L::Value t = L::mul(L::add(L::mul(ox, vdx), L::mul(oy, vdy)), L::load(invLength2));
+    t = L::min(L::max(t, L::set(0)), L::set(1));
+
+    typename L::Value ex = L::sub(ox, L::mul(t, vdx));
+    typename L::Value ey = L::sub(oy, L::mul(t, vdy));
+    typename L::Value d2 = L::add(L::mul(ex, ex), L::mul(ey, ey));
+    return L::bits(L::lessEqual(d2, L::load(r2)));
+}
+
+// Проходит массив блоками ширины WideLanes, остаток - по одному элементу
+template <typename Block>
+void scan(int count, const std::vector<int>& order, std::vector<int>& out, Block block)
+{
+    int i = 0;
+    for (; i + WideLanes::WIDTH <= count; i += WideLanes::WIDTH) {
+        emitHits(block(i, WideLanes()), i, order, out);
+    }
+    for (; i < count; ++i) {
+        emitHits(block(i, ScalarLanes()), i, order, out);
+    }
+}
+
+} // namespace
+
+void HitTestBatch::addCircle(int id, float cx, float cy, float radius)
+{
+    circles_.cx.push_back(cx);
+    circles_.cy.push_back(cy);
+    circles_.r2.push_back(radius * radius);
+    circles_.order.push_back((int)ids_.size());
+    ids_.push_back(id);
+}
+
+void HitTestBatch::addRect(int id, float left, float top, float right, float bottom)
+{
+    rects_.left.push_back(left);
+    rects_.top.push_back(top);
+    rects_.right.push_back(right);
+    rects_.bottom.push_back(bottom);
+    rects_.order.push_back((int)ids_.size());
+    ids_.push_back(id);
+}
+
+void HitTestBatch::addTriangle(int id, float ax, float ay, float bx, float by, float cx, float cy)
+{
+    triangles_.ax.push_back(ax);
+    triangles_.ay.push_back(ay);
+    triangles_.bx.push_back(bx);
+    triangles_.by.push_back(by);
+    triangles_.cx.push_back(cx);
+    triangles_.cy.push_back(cy);
+    triangles_.order.push_back((int)ids_.size());
+    ids_.push_back(id);
+}
+
+void HitTestBatch::addCapsule(int id, float x1, float y1, float x2, float y2, float radius)
+{
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float length2 = dx * dx + dy * dy;
+
+    capsules_.x1.push_back(x1);
+    capsules_.y1.push_back(y1);
+    capsules_.dx.push_back(dx);
+    capsules_.dy.push_back(dy);
+    capsules_.invLength2.push_back(length2 > 0 ? 1.0f / length2 : 0.0f);
+    capsules_.r2.push_back(radius * radius);
+    capsules_.order.push_back((int)ids_.size());
+    ids_.push_back(id);
+}
+
+void HitTestBatch::clear()
+{
+    circles_ = Circles();
+    rects_ = Rects();
+    triangles_ = Triangles();
+    capsules_ = Capsules();
+    ids_.clear();
+}
+
+void HitTestBatch::collect(float x, float y, std::vector<int>& orders) const
+{
+    const Circles& c = circles_;
+    scan((int)c.order.size(), c.order, orders, [&](int i, auto lanes) {
+        typedef decltype(lanes) L;
+        return circleBlock<L>(&c.cx[i], &c.cy[i], &c.r2[i], x, y);
+    });
+
+    const Rects& r = rects_;
+    scan((int)r.order.size(), r.order, orders, [&](int i, auto lanes) {
+        typedef decltype(lanes) L;
+        return rectBlock<L>(&r.left[i], &r.top[i], &r.right[i], &r.bottom[i], x, y);
+    });
+
+    const Triangles& t = triangles_;
+    scan((int)t.order.size(), t.order, orders, [&](int i, auto lanes) {
+        typedef decltype(lanes) L;
+        return triangleBlock<L>(&t.ax[i], &t.ay[i], &t.bx[i], &t.by[i], &t.cx[i], &t.cy[i], x, y);
+    });
+
+    const Capsules& s = capsules_;
+    scan((int)s.order.size(), s.order, orders, [&](int i, auto lanes) {
+        typedef decltype(lanes) L;
+        return capsuleBlock<L>(&s.x1[i], &s.y1[i], &s.dx[i], &s.dy[i], &s.invLength2[i], &s.r2[i], x, y);
+    });
+}
+
+int HitTestBatch::topmost(float x, float y) const
+{
+    std::vector<int> orders;
+    collect(x, y, orders);
+    if (orders.empty()) return -1;
+    return ids_[*std::max_element(orders.begin(), orders.end())];
+}
+
+std::vector<int> HitTestBatch::hits(float x, float y) const
+{
+    std::vector<int> orders;
+    collect(x, y, orders);
+    std::sort(orders.begin(), orders.end());
+
+    // Примитивы одного владельца идут подряд, поэтому повторы соседние
+    std::vector<int> result;
+    for (int order : orders) {
+        if (result.empty() || result.back() != ids_[order]) {
+            result.push_back(ids_[order]);
+        }
+    }
+    return result;
+}
+
+const char* HitTestBatch::kernelName()
+{
+    return KERNEL_NAME;
+}
@@ -0,0 +1,114 @@
+#ifndef HITTEST_H
+#define HITTEST_H
+
+#include <vector>
+
+// Точные проверки попадания точки в примитивы. Используются и фигурами
+// в contains, и пакетной проверкой, чтобы результаты совпадали.
+namespace HitTest {
+
+inline bool inCircle(float px, float py, float cx, float cy, float radius)
+{
+    float dx = px - cx;
+    float dy = py - cy;
+    return dx * dx + dy * dy <= radius * radius;
+}
+
+inline bool inRect(float px, float py, float left, float top, float right, float bottom)
+{
+    return px >= left && px <= right && py >= top && py <= bottom;
+}
+
+// Точка внутри треугольника (или на границе), если знаки векторных
+// произведений по всем трем сторонам не различаются
+inline bool inTriangle(float px, float py, float ax, float ay, float bx, float by, float cx, float cy)
+{
+    float d1 = (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+    float d2 = (cx - bx) * (py - by) - (cy - by) * (px - bx);
+    float d3 = (ax - cx) * (py - cy) - (ay - cy) * (px - cx);
+    bool hasNegative = d1 < 0 || d2 < 0 || d3 < 0;
+    bool hasPositive = d1 > 0 || d2 > 0 || d3 > 0;
+    return !(hasNegative && hasPositive);
+}
+
+// Квадрат расстояния от точки до отрезка
+inline float segmentDistance2(float px, float py, float x1, float y1, float x2, float y2)
+{
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float length2 = dx * dx + dy * dy;
+    // Умножение на 1/|d|^2, как в пакетном ядре, чтобы результаты совпадали
+    float invLength2 = length2 > 0 ? 1.0f / length2 : 0.0f;
+    float t = ((px - x1) * dx + (py - y1) * dy) * invLength2;
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    float ex = px - (x1 + t * dx);
+    float ey = py - (y1 + t * dy);
+    return ex * ex + ey * ey;
+}
+
+// Отрезок с толщиной: точка не дальше radius от отрезка
+inline bool inCapsule(float px, float py, float x1, float y1, float x2, float y2, float radius)
+{
+    return segmentDistance2(px, py, x1, y1, x2, y2) <= radius * radius;
+}
+
+} // namespace HitTest
+
+// Пакетная проверка попадания одной точки во множество примитивов.
+// Координаты хранятся по типам примитивов в отдельных массивах и проверяются
+// векторными ядрами (AVX2 или SSE2, если они включены при сборке, иначе
+// обычным циклом). Каждому примитиву передается id владельца; примитивы
+// одного владельца (например, дети группы) добавляются подряд. Порядок
+// добавления задает z-порядок: добавленный позже лежит выше.
+class HitTestBatch
+{
+public:
+    HitTestBatch() = default;
+
+    void addCircle(int id, float cx, float cy, float radius);
+    void addRect(int id, float left, float top, float right, float bottom);
+    void addTriangle(int id, float ax, float ay, float bx, float by, float cx, float cy);
+    void addCapsule(int id, float x1, float y1, float x2, float y2, float radius);
+
+    void clear();
+    int size() const { return (int)ids_.size(); }
+
+    // id самого верхнего примитива под точкой или -1
+    int topmost(float x, float y) const;
+
+    // id всех владельцев, задетых точкой, в порядке добавления (без повторов)
+    std::vector<int> hits(float x, float y) const;
+
+    // Набор инструкций, выбранный при сборке: "AVX2", "SSE2" или "scalar"
+    static const char* kernelName();
+
+private:
+    struct Circles {
+        std::vector<float> cx, cy, r2;
+        std::vector<int> order;
+    };
+    struct Rects {
+        std::vector<float> left, top, right, bottom;
+        std::vector<int> order;
+    };
+    struct Triangles {
+        std::vector<float> ax, ay, bx, by, cx, cy;
+        std::vector<int> order;
+    };
+    // Отрезки хранятся с заранее вычисленным направлением и 1/|d|^2
+    struct Capsules {
+        std::vector<float> x1, y1, dx, dy, invLength2, r2;
+        std::vector<int> order;
+    };
+
+    Circles circles_;
+    Rects rects_;
+    Triangles triangles_;
+    Capsules capsules_;
+    std::vector<int> ids_;  // id владельца по порядковому номеру примитива
+
+    // Порядковые номера всех примитивов под точкой (без сортировки)
+    void collect(float x, float y, std::vector<int>& orders) const;
+};
+
+#endif // HITTEST_H
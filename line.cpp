@@ -1,27 +1,37 @@
 #include "line.h"
+#include "renderbatch.h"
+#include "hittest.h"
 
-Line::Line(int x1, int y1, int x2, int y2, int thickness) : Shape(x1, y1), x2_(x2), y2_(y2), thickness_(thickness) {}
+Line::Line(int x1, int y1, int x2, int y2, int thickness) : Shape(x1, y1), x2_(x2), y2_(y2), thickness_(thickness) {
+    updateRenderCache();
+}
 
 bool Line::contains(int x, int y) const {
-    int left = std::min(x_, x2_) - thickness_ - 3;
-    int top = std::min(y_, y2_) - thickness_ - 3;
-    int right = std::max(x_, x2_) + thickness_ + 3;
-    int bottom = std::max(y_, y2_) + thickness_ + 3;
-
-    QRect bounds(left, top, right - left, bottom - top);
-    return bounds.contains(x, y);
+    return HitTest::inCapsule(x, y, x_, y_, x2_, y2_, thickness_ / 2.0f + HIT_TOLERANCE);
 }
 
 void Line::draw(QPainter &painter) const {
-    if (selected_) {
-        painter.setPen(QPen(Qt::blue, thickness_ + 2));
-    } else {
-        painter.setPen(QPen(color_, thickness_));
-    }
+    painter.setPen(style_->pen);
 
     painter.drawLine(x_, y_, x2_, y2_);
 }
 
+void Line::addToBatch(RenderBatch &batch) const {
+    batch.addLine(QLine(x_, y_, x2_, y2_), style_->pen);
+}
+
+void Line::addToHitTest(HitTestBatch &batch, int id) const {
+    batch.addCapsule(id, x_, y_, x2_, y2_, thickness_ / 2.0f + HIT_TOLERANCE);
+}
+
+StyleKey Line::styleKey(bool selected) const {
+    // Линия рисуется только пером, заливка ей не нужна
+    if (selected) {
+        return StyleKey::stroke(qRgb(0, 0, 255), thickness_ + 2);
+    }
+    return StyleKey::stroke(ColorRole::Shape, thickness_);
+}
+
 bool Line::checkBounds(int left, int top, int right, int bottom) const {
     QRect bounds = getBorderRect();
     return (bounds.left() >= left &&
@@ -71,4 +81,5 @@ void Line::setEndPoint(int x2, int y2) {
 
 void Line::setThickness(int thickness) {
     thickness_ = thickness;
+    updateStyle();
 }
@@ -15,6 +15,8 @@ public:
     Line(int x1, int y1, int x2, int y2, int thickness = 3);
 
     void draw(QPainter &painter) const override;
+    void addToBatch(RenderBatch &batch) const override;
+    void addToHitTest(HitTestBatch &batch, int id) const override;
     bool contains(int x, int y) const override;
     QRect getBorderRect() const override;
     QRect getSafeBorderRect(int margin = 0) const override;
@@ -28,6 +30,12 @@ public:
     int getThickness() const;
     void setEndPoint(int x2, int y2);
     void setThickness(int thickness);
+
+    // Допуск попадания за пределами толщины линии
+    static const int HIT_TOLERANCE = 3;
+
+protected:
+    StyleKey styleKey(bool selected) const override;
 };
 
 #endif // LINE_H
@@ -8,9 +8,13 @@
 #include "square.h"
 #include "triangle.h"
 #include "line.h"
+#include "renderbatch.h"
 #include <QPainter>
 #include <QMouseEvent>
 #include <QKeyEvent>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QtMath>
 #include <QMenu>
 #include <QMenuBar>
 #include <QToolBar>
@@ -22,12 +26,20 @@
 #include <QTextStream>
 #include <fstream>
 #include <algorithm>
+#include <iterator>
 #include <cmath>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , currentShapeType_(CIRCLE)
+    , backgroundRevision_(0)
+    , tiledRendering_(false)
+    , dragging_(false)
+    , dragPending_(false)
+    , marqueeActive_(false)
+    , marqueeMoved_(false)
+    , marqueePending_(false)
 {
     ui->setupUi(this);
     setWindowTitle("Визуальный редактор - Круг (1)");
@@ -41,6 +53,10 @@ MainWindow::MainWindow(QWidget *parent)
     // Создаем дерево объектов
     treeWidget_ = new ObjectTreeWidget(splitter_);
     treeWidget_->setContainer(&shapes_);
+    connect(treeWidget_, &ObjectTreeWidget::frameRequested, this, &MainWindow::requestFrame);
+
+    // Ввод только накапливает изменения, применяются и рисуются они раз в кадр
+    connect(&frameScheduler_, &FrameScheduler::frame, this, &MainWindow::runFrame);
 
     // Создаем рабочую область
     QWidget* workArea = new QWidget(splitter_);
@@ -104,8 +120,7 @@ void MainWindow::createMenu() {
     deleteAction->setShortcut(QKeySequence::Delete);
     connect(deleteAction, &QAction::triggered, [this]() {
         shapes_.removeSelected();
-        update();
-        treeWidget_->rebuildTree();
+        frameScheduler_.requestFrame();
     });
     editMenu->addAction(deleteAction);
 
@@ -113,8 +128,7 @@ void MainWindow::createMenu() {
     selectAllAction->setShortcut(QKeySequence::SelectAll);
     connect(selectAllAction, &QAction::triggered, [this]() {
         shapes_.selectAll();
-        update();
-        treeWidget_->rebuildTree();
+        frameScheduler_.requestFrame();
     });
     editMenu->addAction(selectAllAction);
 
@@ -137,6 +151,29 @@ void MainWindow::createMenu() {
     decreaseSizeAction->setShortcut(Qt::CTRL | Qt::Key_Minus);
     connect(decreaseSizeAction, &QAction::triggered, this, &MainWindow::decreaseSize);
     editMenu->addAction(decreaseSizeAction);
+
+    QMenu *viewMenu = menuBar()->addMenu("Вид");
+
+    QAction *tiledAction = new QAction("Многопоточная отрисовка", this);
+    tiledAction->setCheckable(true);
+    tiledAction->setChecked(tiledRendering_);
+    connect(tiledAction, &QAction::toggled, this, &MainWindow::setTiledRendering);
+    viewMenu->addAction(tiledAction);
+
+    QAction *zoomInAction = new QAction("Приблизить", this);
+    zoomInAction->setToolTip("Приблизить (Ctrl + колесо мыши)");
+    connect(zoomInAction, &QAction::triggered, this, &MainWindow::zoomIn);
+    viewMenu->addAction(zoomInAction);
+
+    QAction *zoomOutAction = new QAction("Отдалить", this);
+    zoomOutAction->setToolTip("Отдалить (Ctrl + колесо мыши)");
+    connect(zoomOutAction, &QAction::triggered, this, &MainWindow::zoomOut);
+    viewMenu->addAction(zoomOutAction);
+
+    QAction *resetViewAction = new QAction("Исходный масштаб", this);
+    resetViewAction->setShortcut(Qt::CTRL | Qt::Key_0);
+    connect(resetViewAction, &QAction::triggered, this, &MainWindow::resetView);
+    viewMenu->addAction(resetViewAction);
 }
 
 void MainWindow::createToolBar() {
@@ -175,12 +212,16 @@ void MainWindow::createToolBar() {
     connect(colorAction, &QAction::triggered, this, &MainWindow::changeColor);
     toolBar->addAction(colorAction);
 
+    QAction *replaceColorAction = new QAction("Заменить цвет", this);
+    replaceColorAction->setToolTip("Перекрасить все фигуры цвета выделенной");
+    connect(replaceColorAction, &QAction::triggered, this, &MainWindow::replaceColor);
+    toolBar->addAction(replaceColorAction);
+
     QAction *deleteAction = new QAction("Удалить", this);
     deleteAction->setToolTip("Удалить выделенные фигуры (Delete)");
     connect(deleteAction, &QAction::triggered, [this]() {
         shapes_.removeSelected();
-        update();
-        treeWidget_->rebuildTree();
+        frameScheduler_.requestFrame();
     });
     toolBar->addAction(deleteAction);
 
@@ -274,7 +315,23 @@ void MainWindow::changeColor() {
     if (colorDialog.exec() == QDialog::Accepted) {
         QColor color = colorDialog.selectedColor();
         shapes_.setSelectedColor(color);
-        update();
+        frameScheduler_.requestFrame();
+    }
+}
+
+void MainWindow::replaceColor() {
+    std::vector<CompositeElement*> selected = shapes_.getSelectedElements();
+    if (selected.empty()) return;
+
+    QColor from = selected.front()->getColor();
+    QColorDialog colorDialog(this);
+    colorDialog.setWindowTitle("Заменить цвет во всем документе");
+    colorDialog.setCurrentColor(from);
+
+    if (colorDialog.exec() == QDialog::Accepted) {
+        if (shapes_.recolorStyle(from, colorDialog.selectedColor())) {
+            update();
+        }
     }
 }
 
@@ -286,8 +343,8 @@ void MainWindow::clearWindow() {
 
     if (reply == QMessageBox::Yes) {
         shapes_.clear();
+        shapes_.flushChanges();
         update();
-        treeWidget_->rebuildTree();
     }
 }
 
@@ -313,61 +370,333 @@ void MainWindow::updateWindowTitle() {
 }
 
 void MainWindow::paintEvent(QPaintEvent *event) {
-    Q_UNUSED(event);
-
     QPainter painter(this);
+    painter.setClipRegion(event->region());
 
-    // Рисуем фон всего окна
-    painter.fillRect(rect(), Qt::lightGray);
+    // Перерисовываем только поврежденную область
+    painter.fillRect(event->rect(), Qt::lightGray);
 
     // Получаем рабочую область
     QWidget* workArea = splitter_->widget(1);
     QRect workRect = workArea->geometry();
 
-    // Рисуем белую рабочую область
-    painter.fillRect(workRect, Qt::white);
+    // Фон рабочей области с невыделенными фигурами берем из кэша
+    ensureBackgroundCache(workRect.size());
+    painter.drawImage(workRect.topLeft(), backgroundCache_);
+
+    // Область перерисовки в координатах рабочей области
+    QRegion dirtyRegion = event->region().translated(-workRect.topLeft());
 
     // Сохраняем состояние
     painter.save();
 
     // Смещаем начало координат в левый верхний угол рабочей области
+    // и переходим к мировым координатам
     painter.translate(workRect.topLeft());
+    painter.setTransform(viewport_.transform(), true);
+
+    // Поверх фона рисуем только слой выделения
+    std::vector<CompositeElement*> selectedElements;
+    std::vector<Arrow*> selectedArrows;
+    shapes_.getSelectionLayer(selectedElements, selectedArrows);
+
+    RenderBatch batch;
+    batch.setDetailScale(viewport_.zoom());
+    int margin = ShapeContainer::REPAINT_MARGIN;
+    batch.setCullRect(viewport_.mapToWorld(dirtyRegion.boundingRect()).adjusted(-margin, -margin, margin, margin));
+    for (CompositeElement* element : selectedElements) {
+        QRect bounds = element->getSafeBorderRect(ShapeContainer::REPAINT_MARGIN);
+        if (dirtyRegion.intersects(viewport_.mapToScreen(bounds))) {
+            element->addToBatch(batch);
+        }
+    }
 
-    // Рисуем все фигуры
-    for (int i = 0; i < shapes_.getCount(); i++) {
-        CompositeElement* element = shapes_.getElement(i);
-        if (element) {
-            element->draw(painter);
+    for (Arrow* arrow : selectedArrows) {
+        QRect bounds = arrow->getSafeBorderRect(ShapeContainer::REPAINT_MARGIN);
+        if (dirtyRegion.intersects(viewport_.mapToScreen(bounds))) {
+            arrow->addToBatch(batch);
         }
     }
 
-    // Рисуем все стрелки
-    std::vector<Arrow*> arrows = shapes_.getArrows();
-    for (Arrow* arrow : arrows) {
-        arrow->draw(painter);
+    // Элементы, попавшие в тянущуюся рамку, подсвечиваются контуром
+    if (marqueeActive_ && !marqueeHits_.empty()) {
+        QPen previewPen(Qt::blue, 0, Qt::DashLine);
+        for (CompositeElement* element : marqueeHits_) {
+            // Элемент могли удалить, пока тянули рамку: адрес не разыменовываем
+            if (!shapes_.contains(element) || element->getSelected()) continue;
+
+            QRect bounds = element->getBorderRect();
+            if (dirtyRegion.intersects(viewport_.mapToScreen(bounds.adjusted(-margin, -margin, margin, margin)))) {
+                batch.addRect(bounds, previewPen, Qt::NoBrush);
+            }
+        }
     }
+    batch.flush(painter);
 
     painter.restore();
+
+    // Рамка выделения: сплошная - выделяет целиком попавшие, пунктирная - задетые
+    if (marqueeActive_ && marqueeMoved_ && !marqueeRect_.isNull()) {
+        bool inside = marqueePos_.x() >= marqueeOrigin_.x();
+        QRect screen = viewport_.mapToScreen(marqueeRect_).translated(workRect.topLeft());
+        painter.setPen(QPen(Qt::blue, 1, inside ? Qt::SolidLine : Qt::DashLine));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawRect(screen);
+    }
+}
+
+void MainWindow::ensureBackgroundCache(const QSize& size) {
+    qreal ratio = devicePixelRatioF();
+    QSize pixelSize(qCeil(size.width() * ratio), qCeil(size.height() * ratio));
+
+    if (backgroundCache_.size() == pixelSize &&
+        backgroundRevision_ == shapes_.backgroundRevision()) {
+        return;
+    }
+
+    bool full = false;
+    QRect worldDirty = shapes_.takeBackgroundDirty(full);
+    backgroundRevision_ = shapes_.backgroundRevision();
+
+    // Целиком фон перерисовывается только при смене размера или вида
+    // (viewportChanged сбрасывает кэш) и при массовых изменениях документа
+    if (backgroundCache_.size() != pixelSize || full) {
+        backgroundCache_ = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+        backgroundCache_.setDevicePixelRatio(ratio);
+        backgroundCache_.fill(Qt::white);
+
+        if (tiledRendering_) {
+            tiledRenderer_.render(shapes_, viewport_, backgroundCache_, true);
+            return;
+        }
+        renderBackground(QRect(QPoint(0, 0), size));
+        return;
+    }
+
+    // Иначе дорисовываем только накопленную поврежденную область
+    int margin = ShapeContainer::REPAINT_MARGIN;
+    QRect screenDirty = viewport_.mapToScreen(worldDirty)
+                            .adjusted(-margin, -margin, margin, margin)
+                            .intersected(QRect(QPoint(0, 0), size));
+    if (screenDirty.isEmpty()) {
+        return;
+    }
+    renderBackground(screenDirty);
+}
+
+void MainWindow::renderBackground(const QRect& screenRect) {
+    QPainter painter(&backgroundCache_);
+    painter.setClipRect(screenRect);
+    painter.fillRect(screenRect, Qt::white);
+    painter.setTransform(viewport_.transform());
+
+    // Рисуем только то, что попадает в перерисовываемую часть мира
+    int margin = ShapeContainer::REPAINT_MARGIN;
+    QRect area = viewport_.mapToWorld(screenRect).adjusted(-margin, -margin, margin, margin);
+
+    RenderBatch batch;
+    batch.setDetailScale(viewport_.zoom());
+    batch.setCullRect(area);
+    for (CompositeElement* element : shapes_.findElementsInRect(area)) {
+        if (!shapes_.isInSelectionLayer(element)) {
+            element->addToBatch(batch);
+        }
+    }
+
+    for (Arrow* arrow : shapes_.findArrowsInRect(area)) {
+        if (!shapes_.isInSelectionLayer(arrow)) {
+            arrow->addToBatch(batch);
+        }
+    }
+    batch.flush(painter);
+}
+
+void MainWindow::requestFrame() {
+    frameScheduler_.requestFrame();
+}
+
+void MainWindow::runFrame() {
+    // Все смещения выделения за кадр применяются одним перемещением
+    QPoint move = frameScheduler_.takeMove();
+    if (!move.isNull()) {
+        QRect world = Viewport::worldRect();
+        shapes_.moveSelected(move.x(), move.y(), world.right(), world.bottom(), world.top());
+    }
+
+    // Перетаскивание: один сдвиг и одно ограничение границами на кадр.
+    // Якорь сдвигается на примененное смещение, поэтому упершееся в край
+    // выделение догоняет указатель, только когда тот вернется.
+    if (dragPending_) {
+        dragPending_ = false;
+        QPoint delta = dragPos_ - dragAnchor_;
+        dragAnchor_ += shapes_.dragSelected(delta.x(), delta.y(), Viewport::worldRect());
+    }
+
+    if (marqueePending_) {
+        marqueePending_ = false;
+        updateMarquee();
+    }
+
+    repaintDirty();
+}
+
+void MainWindow::beginMarquee(const QPoint& local) {
+    marqueeActive_ = true;
+    marqueeMoved_ = false;
+    marqueePending_ = false;
+    marqueeScreenOrigin_ = local;
+    marqueeOrigin_ = viewport_.mapToWorld(local);
+    marqueePos_ = marqueeOrigin_;
+    marqueeRect_ = QRect();
+    marqueeHits_.clear();
+}
+
+void MainWindow::updateMarquee() {
+    QRect rect = QRect(marqueeOrigin_, marqueePos_).normalized();
+
+    // Рамка слева направо выделяет только целиком попавшие элементы,
+    // справа налево - все задетые
+    bool inside = marqueePos_.x() >= marqueeOrigin_.x();
+    std::vector<CompositeElement*> hits = shapes_.elementsInRect(rect, inside);
+    std::sort(hits.begin(), hits.end());
+
+    // Перерисовываем подсветку только у элементов, вошедших в рамку или
+    // вышедших из нее; выделение в контейнере не меняется до отпускания
+    std::vector<CompositeElement*> changed;
+    std::set_symmetric_difference(marqueeHits_.begin(), marqueeHits_.end(), hits.begin(), hits.end(),
+                                  std::back_inserter(changed));
+
+    QRect dirty = marqueeScreenRect(marqueeRect_).united(marqueeScreenRect(rect));
+    for (CompositeElement* element : changed) {
+        if (shapes_.contains(element)) {
+            dirty = dirty.united(marqueeScreenRect(element->getSafeBorderRect(ShapeContainer::REPAINT_MARGIN)));
+        }
+    }
+    marqueeHits_.swap(hits);
+
+    // Стираем старую рамку и рисуем новую
+    update(dirty);
+    marqueeRect_ = rect;
+}
+
+void MainWindow::endMarquee() {
+    if (marqueeMoved_) {
+        // Последнее положение применяется сразу, не дожидаясь кадра
+        marqueePending_ = false;
+        updateMarquee();
+        update(marqueeScreenRect(marqueeRect_));
+
+        // Выделение переносится в контейнер одним проходом; с Ctrl прежнее
+        // выделение сохраняется, без него оно снято еще при нажатии
+        for (CompositeElement* element : marqueeHits_) {
+            if (shapes_.contains(element)) {
+                shapes_.setElementSelected(element, true);
+            }
+        }
+    } else {
+        // Щелчок по пустому месту без перетаскивания создает фигуру
+        createNewShape(marqueeOrigin_.x(), marqueeOrigin_.y());
+    }
+
+    marqueeActive_ = false;
+    marqueeMoved_ = false;
+    marqueeRect_ = QRect();
+    marqueeHits_.clear();
+    frameScheduler_.requestFrame();
+}
+
+QRect MainWindow::marqueeScreenRect(const QRect& world) const {
+    if (world.isNull()) return QRect();
+
+    QRect workRect = splitter_->widget(1)->geometry();
+    return viewport_.mapToScreen(world).translated(workRect.topLeft()).adjusted(-2, -2, 2, 2);
+}
+
+void MainWindow::repaintDirty() {
+    // Накопленные за кадр изменения уходят подписчикам (дереву объектов) одним набором
+    shapes_.flushChanges();
+
+    QRect dirty = shapes_.takeDirtyRect();
+    if (dirty.isEmpty()) return;
+
+    QWidget* workArea = splitter_->widget(1);
+    QRect workRect = workArea->geometry();
+
+    // Поврежденная область хранится в мировых координатах
+    QRect screenDirty = viewport_.mapToScreen(dirty);
+    update(screenDirty.translated(workRect.topLeft()).intersected(workRect));
+}
+
+QRect MainWindow::visibleWorldRect() const {
+    QWidget* workArea = splitter_->widget(1);
+    return viewport_.mapToWorld(workArea->rect());
+}
+
+void MainWindow::viewportChanged() {
+    // Кэш фона нарисован в экранных координатах и после смены вида устарел
+    backgroundCache_ = QImage();
+    shapes_.takeDirtyRect();
+    update();
+}
+
+void MainWindow::wheelEvent(QWheelEvent *event) {
+    QWidget* workArea = splitter_->widget(1);
+    QPointF anchor = event->position() - QPointF(workArea->geometry().topLeft());
+    QPoint delta = event->angleDelta();
+
+    if (event->modifiers() & Qt::ControlModifier) {
+        // Один щелчок колеса (120) меняет масштаб на 25%
+        qreal factor = std::pow(1.25, delta.y() / 120.0);
+        viewport_.zoomAt(factor, anchor);
+    } else if (event->modifiers() & Qt::ShiftModifier) {
+        viewport_.panBy(QPointF(delta.y(), 0));
+    } else {
+        viewport_.panBy(QPointF(delta.x(), delta.y()));
+    }
+
+    viewportChanged();
+    event->accept();
+}
+
+void MainWindow::zoomIn() {
+    QWidget* workArea = splitter_->widget(1);
+    viewport_.zoomAt(1.25, QPointF(workArea->rect().center()));
+    viewportChanged();
+}
+
+void MainWindow::zoomOut() {
+    QWidget* workArea = splitter_->widget(1);
+    viewport_.zoomAt(1 / 1.25, QPointF(workArea->rect().center()));
+    viewportChanged();
+}
+
+void MainWindow::resetView() {
+    viewport_.reset();
+    viewportChanged();
 }
 
 void MainWindow::createNewShape(int x, int y) {
     CompositeElement* newElement = nullptr;
     int margin = 10;
 
-    QWidget* workArea = splitter_->widget(1);
-    int workWidth = workArea->width();
-    int workHeight = workArea->height();
+    // Новая фигура ограничивается видимой частью мира, чтобы сразу оказаться на экране.
+    // Ниже координаты считаются относительно этой области, а в конце фигура сдвигается в мир.
+    QRect area = visibleWorldRect().intersected(Viewport::worldRect());
+    x -= area.left();
+    y -= area.top();
+    int workWidth = area.width();
+    int workHeight = area.height();
 
     switch (currentShapeType_) {
     case CIRCLE: {
         int radius = 40;
         if (x - radius >= margin && x + radius <= workWidth - margin &&
             y - radius >= margin && y + radius <= workHeight - margin) {
-            newElement = new ShapeAdapter(new Circle(x, y, radius));
+            newElement = new ShapeAdapter(Circle(x, y, radius));
         } else {
             int safeX = std::max(margin + radius, std::min(x, workWidth - margin - radius));
             int safeY = std::max(margin + radius, std::min(y, workHeight - margin - radius));
-            newElement = new ShapeAdapter(new Circle(safeX, safeY, radius));
+            newElement = new ShapeAdapter(Circle(safeX, safeY, radius));
         }
         break;
     }
@@ -380,11 +709,11 @@ void MainWindow::createNewShape(int x, int y) {
 
         if (leftX >= margin && leftX + rectWidth <= workWidth - margin &&
             topY >= margin && topY + rectHeight <= workHeight - margin) {
-            newElement = new ShapeAdapter(new Rectangle(leftX, topY, rectWidth, rectHeight));
+            newElement = new ShapeAdapter(Rectangle(leftX, topY, rectWidth, rectHeight));
         } else {
             int safeLeftX = std::max(margin, std::min(leftX, workWidth - margin - rectWidth));
             int safeTopY = std::max(margin, std::min(topY, workHeight - margin - rectHeight));
-            newElement = new ShapeAdapter(new Rectangle(safeLeftX, safeTopY, rectWidth, rectHeight));
+            newElement = new ShapeAdapter(Rectangle(safeLeftX, safeTopY, rectWidth, rectHeight));
         }
         break;
     }
@@ -396,11 +725,11 @@ void MainWindow::createNewShape(int x, int y) {
 
         if (leftX >= margin && leftX + size <= workWidth - margin &&
             topY >= margin && topY + size <= workHeight - margin) {
-            newElement = new ShapeAdapter(new Square(leftX, topY, size));
+            newElement = new ShapeAdapter(Square(leftX, topY, size));
         } else {
             int safeLeftX = std::max(margin, std::min(leftX, workWidth - margin - size));
             int safeTopY = std::max(margin, std::min(topY, workHeight - margin - size));
-            newElement = new ShapeAdapter(new Square(safeLeftX, safeTopY, size));
+            newElement = new ShapeAdapter(Square(safeLeftX, safeTopY, size));
         }
         break;
     }
@@ -415,11 +744,11 @@ void MainWindow::createNewShape(int x, int y) {
         // Проверяем границы треугольника
         if (newX >= margin && newX + size <= workWidth - margin &&
             newY - size/2 >= margin && newY + size/2 <= workHeight - margin) {
-            newElement = new ShapeAdapter(new Triangle(newX, newY, size));
+            newElement = new ShapeAdapter(Triangle(newX, newY, size));
         } else {
             int safeX = std::max(margin, std::min(newX, workWidth - margin - size));
             int safeY = std::max(margin + size/2, std::min(newY, workHeight - margin - size/2));
-            newElement = new ShapeAdapter(new Triangle(safeX, safeY, size));
+            newElement = new ShapeAdapter(Triangle(safeX, safeY, size));
         }
         break;
     }
@@ -434,21 +763,20 @@ void MainWindow::createNewShape(int x, int y) {
 
         if (startX >= margin && endX <= workWidth - margin &&
             startY >= margin && startY <= workHeight - margin) {
-            newElement = new ShapeAdapter(new Line(startX, startY, endX, endY));
+            newElement = new ShapeAdapter(Line(startX, startY, endX, endY));
         } else {
             int safeStartX = std::max(margin, std::min(startX, workWidth - margin - length));
             int safeY = std::max(margin, std::min(y, workHeight - margin));
-            newElement = new ShapeAdapter(new Line(safeStartX, safeY, safeStartX + length, safeY));
+            newElement = new ShapeAdapter(Line(safeStartX, safeY, safeStartX + length, safeY));
         }
         break;
     }
     }
 
     if (newElement) {
+        newElement->move(area.left(), area.top());
         newElement->setSelected(false);
         shapes_.addElement(newElement);
-        shapes_.notifySelectionChanged();
-        treeWidget_->rebuildTree();
     }
 }
 
@@ -470,6 +798,12 @@ void MainWindow::mousePressEvent(QMouseEvent *event)
 
         bool ctrlPressed = event->modifiers() & Qt::ControlModifier;
 
+        // Дальше работаем в мировых координатах
+        QPoint local(x, y);
+        QPoint world = viewport_.mapToWorld(local);
+        x = world.x();
+        y = world.y();
+
         // Ищем объект под курсором (включая стрелки)
         CompositeElement* clicked = shapes_.findElementAt(x, y, true);
 
@@ -477,61 +811,108 @@ void MainWindow::mousePressEvent(QMouseEvent *event)
             // Режим создания стрелки
             if (!shapes_.getArrowSource()) {
                 // Выбираем первый объект
-                if (clicked && !dynamic_cast<Arrow*>(clicked)) {
+                if (clicked && clicked->kind() != ShapeKind::Arrow) {
                     shapes_.setArrowSource(clicked);
                     shapes_.clearSelection();
-                    clicked->setSelected(true);
+                    shapes_.setElementSelected(clicked, true);
                 }
             } else {
                 // Выбираем второй объект и создаем стрелку
-                if (clicked && !dynamic_cast<Arrow*>(clicked) &&
+                if (clicked && clicked->kind() != ShapeKind::Arrow &&
                     clicked != shapes_.getArrowSource()) {
                     shapes_.addArrow(shapes_.getArrowSource(), clicked, false);
                     shapes_.clearSelection();
                     shapes_.clearArrowSource();
                     arrowMode_ = false;
-                    treeWidget_->rebuildTree();
                 }
             }
-            update();
+            frameScheduler_.requestFrame();
             return;
         }
 
         // Обычный режим выделения
         if (ctrlPressed) {
             if (clicked) {
-                clicked->setSelected(!clicked->getSelected());
-                treeWidget_->syncSelectionFromContainer();
+                shapes_.setElementSelected(clicked, !clicked->getSelected());
             } else {
-                createNewShape(x, y);
+                beginMarquee(local);
             }
         } else {
             if (clicked) {
                 if (!clicked->getSelected()) {
                     shapes_.clearSelection();
-                    clicked->setSelected(true);
-                    treeWidget_->syncSelectionFromContainer();
+                    shapes_.setElementSelected(clicked, true);
+                }
+                // Нажатие на фигуру начинает перетаскивание выделения
+                if (clicked->kind() != ShapeKind::Arrow) {
+                    dragging_ = true;
+                    dragPending_ = false;
+                    dragAnchor_ = world;
+                    dragPos_ = world;
                 }
             } else {
                 shapes_.clearSelection();
-                treeWidget_->syncSelectionFromContainer();
-                createNewShape(x, y);
+                beginMarquee(local);
             }
         }
 
-        update();
+        frameScheduler_.requestFrame();
     }
     else if (event->button() == Qt::RightButton) {
         shapes_.clearSelection();
         shapes_.clearArrowSource();
         arrowMode_ = false;
-        treeWidget_->syncSelectionFromContainer();
-        update();
+        frameScheduler_.requestFrame();
     }
 
     QMainWindow::mousePressEvent(event);
 }
 
+void MainWindow::mouseMoveEvent(QMouseEvent *event)
+{
+    if (dragging_ && (event->buttons() & Qt::LeftButton)) {
+        // Запоминаем только последнее положение: все движения за кадр
+        // применяются одним сдвигом в runFrame
+        QRect workRect = splitter_->widget(1)->geometry();
+        dragPos_ = viewport_.mapToWorld(event->pos() - workRect.topLeft());
+        dragPending_ = true;
+        frameScheduler_.requestFrame();
+        return;
+    }
+
+    if (marqueeActive_ && (event->buttons() & Qt::LeftButton)) {
+        QPoint local = event->pos() - splitter_->widget(1)->geometry().topLeft();
+
+        // Мелкое дрожание при щелчке не превращает его в рамку
+        if (!marqueeMoved_ && (local - marqueeScreenOrigin_).manhattanLength() < MARQUEE_THRESHOLD) {
+            return;
+        }
+        marqueeMoved_ = true;
+        marqueePos_ = viewport_.mapToWorld(local);
+        marqueePending_ = true;
+        frameScheduler_.requestFrame();
+        return;
+    }
+
+    QMainWindow::mouseMoveEvent(event);
+}
+
+void MainWindow::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton && dragging_) {
+        // Последний сдвиг, если он еще не применен, выполнит ближайший кадр
+        dragging_ = false;
+        return;
+    }
+
+    if (event->button() == Qt::LeftButton && marqueeActive_) {
+        endMarquee();
+        return;
+    }
+
+    QMainWindow::mouseReleaseEvent(event);
+}
+
 void MainWindow::keyPressEvent(QKeyEvent *event)
 {
     bool needUpdate = false;
@@ -542,7 +923,6 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
     case Qt::Key_Backspace:
         qDebug() << "Delete key pressed";
         shapes_.removeSelected();
-        treeWidget_->rebuildTree();
         needUpdate = true;
         break;
 
@@ -589,14 +969,12 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
 
     case Qt::Key_Escape:
         shapes_.clearSelection();
-        treeWidget_->syncSelectionFromContainer();
         needUpdate = true;
         break;
 
     case Qt::Key_A:
         if (event->modifiers() & Qt::ControlModifier) {
             shapes_.selectAll();
-            treeWidget_->syncSelectionFromContainer();
             needUpdate = true;
         }
         break;
@@ -629,17 +1007,14 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
     }
 
     if (dx != 0 || dy != 0) {
-        QWidget* workArea = splitter_->widget(1);
-        int workWidth = workArea->width();
-        int workHeight = workArea->height();
-
-        shapes_.moveSelected(dx, dy, workWidth, workHeight, 0);
-        treeWidget_->syncSelectionFromContainer();
-        needUpdate = true;
+        // Шаг задан в пикселях экрана, а перемещение выполняется в мире.
+        // Шаги автоповтора складываются и применяются одним перемещением за кадр
+        int step = std::max(1, qRound(1.0 / viewport_.zoom()));
+        frameScheduler_.addMove(dx * step, dy * step);
     }
 
     if (needUpdate) {
-        update();
+        frameScheduler_.requestFrame();
     }
 
     QMainWindow::keyPressEvent(event);
@@ -647,32 +1022,26 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
 
 void MainWindow::groupSelected() {
     shapes_.groupSelected();
-    treeWidget_->rebuildTree();
-    update();
+    frameScheduler_.requestFrame();
 }
 
 void MainWindow::ungroupSelected() {
     shapes_.ungroupSelected();
-    treeWidget_->rebuildTree();
-    update();
+    frameScheduler_.requestFrame();
 }
 
 void MainWindow::resizeSelected(int delta) {
-    QToolBar* toolBar = findChild<QToolBar*>();
-    int toolBarHeight = toolBar ? toolBar->height() : 30;
-    int usableTop = toolBarHeight;
-
-    for (int i = 0; i < shapes_.getCount(); i++) {
-        CompositeElement* element = shapes_.getElement(i);
-        if (element && element->getSelected()) {
-            if (element->isGroup()) {
-                resizeGroupElements(element, delta, width(), height(), usableTop);
-            } else {
-                applyResizeWithBounds(element, delta, width(), height(), usableTop);
-            }
+    QRect world = Viewport::worldRect();
+
+    for (CompositeElement* element : shapes_.getSelectedElements()) {
+        if (element->isGroup()) {
+            resizeGroupElements(element, delta, world.right(), world.bottom(), world.top());
+        } else {
+            applyResizeWithBounds(element, delta, world.right(), world.bottom(), world.top());
         }
+        shapes_.elementGeometryChanged(element);
     }
-    update();
+    frameScheduler_.requestFrame();
 }
 
 void MainWindow::resizeGroupElements(CompositeElement* group, int delta, int maxX, int maxY, int topMargin) {
@@ -713,38 +1082,46 @@ bool MainWindow::canResizeElement(CompositeElement* element, int delta, int maxX
 }
 
 void MainWindow::applyResize(CompositeElement* element, int delta) {
-    ShapeAdapter* adapter = dynamic_cast<ShapeAdapter*>(element);
-    if (!adapter) return;
+    // Размеры меняются только у листовых фигур, тип определяется по тегу
+    if (!element || !isLeafKind(element->kind())) return;
+    LeafShape& leaf = static_cast<ShapeAdapter*>(element)->getLeaf();
 
-    Shape* shape = adapter->getShape();
-    if (!shape) return;
-
-    if (Circle* circle = dynamic_cast<Circle*>(shape)) {
+    switch (element->kind()) {
+    case ShapeKind::Circle: {
+        Circle* circle = std::get_if<Circle>(&leaf);
         int newRadius = circle->getRadius() + delta;
         if (newRadius >= 5 && newRadius <= 100) {
             circle->setRadius(newRadius);
         }
+        break;
     }
-    else if (Rectangle* rect = dynamic_cast<Rectangle*>(shape)) {
+    case ShapeKind::Rectangle: {
+        Rectangle* rect = std::get_if<Rectangle>(&leaf);
         int newWidth = rect->getWidth() + delta;
         int newHeight = rect->getHeight() + delta;
         if (newWidth >= 10 && newWidth <= 200 && newHeight >= 10 && newHeight <= 200) {
             rect->setSize(newWidth, newHeight);
         }
+        break;
     }
-    else if (Square* square = dynamic_cast<Square*>(shape)) {
+    case ShapeKind::Square: {
+        Square* square = std::get_if<Square>(&leaf);
         int newSize = square->getSide() + delta;
         if (newSize >= 10 && newSize <= 200) {
             square->setSide(newSize);
         }
+        break;
     }
-    else if (Triangle* triangle = dynamic_cast<Triangle*>(shape)) {
+    case ShapeKind::Triangle: {
+        Triangle* triangle = std::get_if<Triangle>(&leaf);
         int newSize = triangle->getSize() + delta;
         if (newSize >= 10 && newSize <= 150) {
             triangle->setSize(newSize);
         }
+        break;
     }
-    else if (Line* line = dynamic_cast<Line*>(shape)) {
+    case ShapeKind::Line: {
+        Line* line = std::get_if<Line>(&leaf);
         int x1 = line->getX();
         int y1 = line->getY();
         int x2 = line->getX2();
@@ -776,7 +1153,14 @@ void MainWindow::applyResize(CompositeElement* element, int delta) {
                 line->setEndPoint(newX2, newY2);
             }
         }
+        break;
+    }
+    default:
+        break;
     }
+
+    // Размер меняется напрямую у фигуры, поэтому группы-предки узнают об этом отсюда
+    element->notifyGeometryChanged();
 }
 
 void MainWindow::collectAllElementsForResize(CompositeElement* element, std::vector<CompositeElement*>& result) {
@@ -795,13 +1179,12 @@ void MainWindow::applyResizeWithBounds(CompositeElement* element, int delta, int
 bool MainWindow::canResizeWithBounds(CompositeElement* element, int delta, int maxX, int maxY, int topMargin) {
     if (delta <= 0) return true;
 
-    ShapeAdapter* adapter = dynamic_cast<ShapeAdapter*>(element);
-    if (!adapter) return true;
-
-    Shape* shape = adapter->getShape();
-    if (!shape) return true;
+    if (!element || !isLeafKind(element->kind())) return true;
+    LeafShape& leaf = static_cast<ShapeAdapter*>(element)->getLeaf();
 
-    if (Circle* circle = dynamic_cast<Circle*>(shape)) {
+    switch (element->kind()) {
+    case ShapeKind::Circle: {
+        Circle* circle = std::get_if<Circle>(&leaf);
         int newRadius = circle->getRadius() + delta;
 
         QRect newBounds(circle->getX() - newRadius,
@@ -813,7 +1196,8 @@ bool MainWindow::canResizeWithBounds(CompositeElement* element, int delta, int m
                 newBounds.top() >= topMargin &&
                 newBounds.bottom() <= maxY);
     }
-    else if (Rectangle* rect = dynamic_cast<Rectangle*>(shape)) {
+    case ShapeKind::Rectangle: {
+        Rectangle* rect = std::get_if<Rectangle>(&leaf);
         int newWidth = rect->getWidth() + delta;
         int newHeight = rect->getHeight() + delta;
 
@@ -824,7 +1208,8 @@ bool MainWindow::canResizeWithBounds(CompositeElement* element, int delta, int m
                 newBounds.top() >= topMargin &&
                 newBounds.bottom() <= maxY);
     }
-    else if (Square* square = dynamic_cast<Square*>(shape)) {
+    case ShapeKind::Square: {
+        Square* square = std::get_if<Square>(&leaf);
         int newSize = square->getSide() + delta;
 
         QRect newBounds(square->getX(), square->getY(), newSize, newSize);
@@ -834,7 +1219,8 @@ bool MainWindow::canResizeWithBounds(CompositeElement* element, int delta, int m
                 newBounds.top() >= topMargin &&
                 newBounds.bottom() <= maxY);
     }
-    else if (Triangle* triangle = dynamic_cast<Triangle*>(shape)) {
+    case ShapeKind::Triangle: {
+        Triangle* triangle = std::get_if<Triangle>(&leaf);
         int newSize = triangle->getSize() + delta;
 
         QRect newBounds(triangle->getX(),
@@ -846,7 +1232,8 @@ bool MainWindow::canResizeWithBounds(CompositeElement* element, int delta, int m
                 newBounds.top() >= topMargin &&
                 newBounds.bottom() <= maxY);
     }
-    else if (Line* line = dynamic_cast<Line*>(shape)) {
+    case ShapeKind::Line: {
+        Line* line = std::get_if<Line>(&leaf);
         int x1 = line->getX();
         int y1 = line->getY();
         int x2 = line->getX2();
@@ -874,6 +1261,9 @@ bool MainWindow::canResizeWithBounds(CompositeElement* element, int delta, int m
                 top >= topMargin &&
                 bottom <= maxY);
     }
+    default:
+        break;
+    }
 
     return true;
 }
@@ -930,8 +1320,8 @@ void MainWindow::loadFromFile()
 
     if (shapes_.loadFromFile(fileName.toStdString())) {
         QMessageBox::information(this, "Загрузка", "Проект успешно загружен из файла " + fileName);
+        shapes_.flushChanges();
         update();
-        treeWidget_->rebuildTree();
     } else {
         QMessageBox::critical(this, "Ошибка", "Не удалось загрузить проект из файла " + fileName);
     }
@@ -943,13 +1333,10 @@ void MainWindow::handleKeyEvent(QKeyEvent* event) {
 
 void MainWindow::testSelection() {
     if (shapes_.getCount() > 0) {
-        // Снимаем выделение со всех
-        for (int i = 0; i < shapes_.getCount(); i++) {
-            shapes_.getElement(i)->setSelected(false);
-        }
-        // Выделяем первый элемент
-        shapes_.getElement(0)->setSelected(true);
-        shapes_.notifySelectionChanged();
+        // Снимаем выделение со всех и выделяем первый элемент
+        shapes_.clearSelection();
+        shapes_.setElementSelected(shapes_.getElement(0), true);
+        shapes_.flushChanges();
         update();
     }
 }
@@ -964,8 +1351,7 @@ void MainWindow::addArrow(bool bidirectional) {
 
     shapes_.addArrow(selected[0], selected[1], bidirectional);
     shapes_.clearSelection();
-    treeWidget_->rebuildTree();
-    update();
+    frameScheduler_.requestFrame();
 }
 
 void MainWindow::setArrowMode(bool enabled) {
@@ -978,6 +1364,10 @@ void MainWindow::setArrowMode(bool enabled) {
     }
 }
 
+void MainWindow::setTiledRendering(bool enabled) {
+    tiledRendering_ = enabled;
+}
+
 MainWindow::~MainWindow()
 {
     delete ui;
@@ -4,7 +4,11 @@
 #include <QMainWindow>
 #include "shapecontainer.h"
 #include "objecttreewidget.h"
+#include "tiledrenderer.h"
+#include "viewport.h"
+#include "framescheduler.h"
 #include <QSplitter>
+#include <QImage>
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -28,11 +32,17 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
     void handleKeyEvent(QKeyEvent* event);  // Для обработки клавиш из дерева
+    // Запрашивает кадр: изменения контейнера разошлются и перерисуется
+    // только грязная область
+    void requestFrame();
 
 protected:
     void paintEvent(QPaintEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
 
 private slots:
     void selectCircle();
@@ -41,6 +51,7 @@ private slots:
     void selectTriangle();
     void selectLine();
     void changeColor();
+    void replaceColor();
     void clearWindow();
     void increaseSize();
     void decreaseSize();
@@ -54,6 +65,13 @@ private slots:
 
     void addArrow(bool bidirectional);
     void setArrowMode(bool enabled);
+    void setTiledRendering(bool enabled);
+
+    void zoomIn();
+    void zoomOut();
+    void resetView();
+
+    void runFrame();
 
 private:
     Ui::MainWindow *ui;
@@ -63,9 +81,54 @@ private:
     ShapeType currentShapeType_ = CIRCLE;
     bool arrowMode_;
 
+    // Кэш невыделенных фигур; выделение рисуется поверх него каждый кадр
+    QImage backgroundCache_;
+    quint64 backgroundRevision_;
+
+    // Необязательная многопоточная растеризация фона по плиткам
+    TiledRenderer tiledRenderer_;
+    bool tiledRendering_;
+
+    // Панорамирование и масштаб рабочей области
+    Viewport viewport_;
+
+    // Объединяет ввод за кадр: перемещение, синхронизация дерева и перерисовка
+    FrameScheduler frameScheduler_;
+
+    // Перетаскивание выделения мышью (в мировых координатах)
+    bool dragging_;
+    bool dragPending_;   // Указатель сдвинулся после последнего кадра
+    QPoint dragPos_;     // Последнее положение указателя
+    QPoint dragAnchor_;  // Точка, до которой выделение уже сдвинуто
+
+    // Рамка выделения. Начинается нажатием на пустое место; без перетаскивания
+    // при отпускании создается фигура, как раньше при щелчке. Пока рамку тянут,
+    // попавшие в нее элементы только подсвечиваются поверх фона, а в
+    // контейнер выделение переносится один раз при отпускании - фон из-за
+    // движения рамки не перерисовывается.
+    static const int MARQUEE_THRESHOLD = 4;  // В пикселях экрана
+    bool marqueeActive_;
+    bool marqueeMoved_;
+    bool marqueePending_;   // Указатель сдвинулся после последнего кадра
+    QPoint marqueeScreenOrigin_;
+    QPoint marqueeOrigin_;  // Углы рамки в мировых координатах
+    QPoint marqueePos_;
+    QRect marqueeRect_;     // Последняя примененная рамка
+    std::vector<CompositeElement*> marqueeHits_;  // Попавшие в рамку, по адресу
+
     void createMenu();
     void createToolBar();
     void updateWindowTitle();
+    void repaintDirty();
+    void beginMarquee(const QPoint& local);
+    void updateMarquee();
+    void endMarquee();
+    QRect marqueeScreenRect(const QRect& world) const;
+    void ensureBackgroundCache(const QSize& size);
+    // Перерисовывает фон в кэше внутри экранного прямоугольника
+    void renderBackground(const QRect& screenRect);
+    QRect visibleWorldRect() const;
+    void viewportChanged();
     void resizeSelected(int delta);
     void applyResize(CompositeElement* element, int delta);
     void applyResizeWithBounds(CompositeElement* element, int delta, int maxX, int maxY, int topMargin);
@@ -0,0 +1,324 @@
+#include "objecttreemodel.h"
+#include "shapecontainer.h"
+#include "arrow.h"
+#include <QBrush>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <unordered_set>
+
+ObjectTreeModel::ObjectTreeModel(QObject* parent)
+    : QAbstractItemModel(parent), container_(nullptr), elementCount_(0) {
+}
+
+ObjectTreeModel::~ObjectTreeModel() = default;
+
+void ObjectTreeModel::setContainer(ShapeContainer* container) {
+    container_ = container;
+    reload();
+}
+
+void ObjectTreeModel::reload() {
+    beginResetModel();
+
+    nodes_.clear();
+    root_.children.clear();
+    topLevel_.clear();
+    elementCount_ = 0;
+
+    if (container_) {
+        // Копируются только указатели, узлы строк создаются при загрузке
+        topLevel_.reserve(container_->getCount() + container_->getArrowCount());
+        for (int i = 0; i < container_->getCount(); ++i) {
+            if (CompositeElement* element = container_->getElement(i)) {
+                topLevel_.push_back(element);
+            }
+        }
+        elementCount_ = (int)topLevel_.size();
+        for (int i = 0; i < container_->getArrowCount(); ++i) {
+            topLevel_.push_back(container_->getArrow(i));
+        }
+    }
+
+    endResetModel();
+}
+
+void ObjectTreeModel::applyChanges(const ChangeSet& changes) {
+    if (!container_) return;
+
+    bool added = changes.has(EventKind::ElementAdded);
+    bool removed = changes.has(EventKind::ElementRemoved);
+
+    // Добавление вместе с удалением не разделить: адрес удаленного элемента
+    // мог достаться новому. Без списка элементов изменения тоже не разобрать.
+    if (changes.has(EventKind::ContainerChanged) || (added && removed) ||
+        ((added || removed) && changes.elements.empty())) {
+        reload();
+        return;
+    }
+
+    if (removed) {
+        removeTopLevel(changes.elements);
+    }
+    if (added) {
+        appendFromContainer();
+    }
+    if (changes.has(EventKind::SelectionChanged)) {
+        refreshSelection(changes.elements);
+    }
+}
+
+CompositeElement* ObjectTreeModel::elementAt(const QModelIndex& index) const {
+    return index.isValid() ? nodeOf(index)->element : nullptr;
+}
+
+QModelIndex ObjectTreeModel::indexOf(const CompositeElement* element) const {
+    auto it = nodes_.find(element);
+    if (it == nodes_.end()) return QModelIndex();
+    return createIndex(it->second->row, 0, it->second);
+}
+
+QModelIndex ObjectTreeModel::index(int row, int column, const QModelIndex& parent) const {
+    Node* node = nodeOf(parent);
+    if (column != 0 || row < 0 || row >= (int)node->children.size()) {
+        return QModelIndex();
+    }
+    return createIndex(row, 0, node->children[row].get());
+}
+
+QModelIndex ObjectTreeModel::parent(const QModelIndex& child) const {
+    if (!child.isValid()) return QModelIndex();
+
+    Node* parentNode = nodeOf(child)->parent;
+    if (parentNode == &root_) return QModelIndex();
+    return createIndex(parentNode->row, 0, parentNode);
+}
+
+int ObjectTreeModel::rowCount(const QModelIndex& parent) const {
+    if (parent.column() > 0) return 0;
+    return (int)nodeOf(parent)->children.size();
+}
+
+int ObjectTreeModel::columnCount(const QModelIndex& parent) const {
+    (void)parent;
+    return 1;
+}
+
+bool ObjectTreeModel::hasChildren(const QModelIndex& parent) const {
+    // Считаем и еще не загруженных детей, чтобы у группы был значок раскрытия
+    return childCount(nodeOf(parent)) > 0;
+}
+
+QVariant ObjectTreeModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid()) return QVariant();
+
+    CompositeElement* element = nodeOf(index)->element;
+    if (role == Qt::DisplayRole) {
+        switch (element->kind()) {
+        case ShapeKind::Group:
+            return QString("Группа");
+        case ShapeKind::Arrow:
+            return QString("Стрелка");
+        default:
+            // Имя из постоянной таблицы, без временной std::string
+            return QString(QLatin1String(shapeKindName(element->kind())));
+        }
+    }
+    if (role == Qt::ForegroundRole) {
+        return QBrush(element->getSelected() ? Qt::blue : Qt::black);
+    }
+    return QVariant();
+}
+
+QVariant ObjectTreeModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (section == 0 && orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        return QString("Объекты");
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags ObjectTreeModel::flags(const QModelIndex& index) const {
+    if (!index.isValid()) return Qt::NoItemFlags;
+
+    // Дети групп выделяются только вместе с группой
+    if (nodeOf(index)->parent != &root_) return Qt::ItemIsEnabled;
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+bool ObjectTreeModel::canFetchMore(const QModelIndex& parent) const {
+    Node* node = nodeOf(parent);
+    return (int)node->children.size() < childCount(node);
+}
+
+void ObjectTreeModel::fetchMore(const QModelIndex& parent) {
+    Node* node = nodeOf(parent);
+    int from = (int)node->children.size();
+    int to = std::min(childCount(node), from + FETCH_BATCH);
+    if (from >= to) return;
+
+    beginInsertRows(parent, from, to - 1);
+    for (int row = from; row < to; ++row) {
+        auto child = std::make_unique<Node>();
+        child->element = childElement(node, row);
+        child->parent = node;
+        child->row = row;
+        nodes_[child->element] = child.get();
+        node->children.push_back(std::move(child));
+    }
+    endInsertRows();
+}
+
+ObjectTreeModel::Node* ObjectTreeModel::nodeOf(const QModelIndex& index) const {
+    if (!index.isValid()) return const_cast<Node*>(&root_);
+    return static_cast<Node*>(index.internalPointer());
+}
+
+int ObjectTreeModel::childCount(const Node* node) const {
+    if (node == &root_) return (int)topLevel_.size();
+    return node->element->isGroup() ? (int)node->element->getChildren().size() : 0;
+}
+
+CompositeElement* ObjectTreeModel::childElement(const Node* node, int row) const {
+    if (node == &root_) return topLevel_[row];
+    return node->element->getChildren()[row];
+}
+
+void ObjectTreeModel::forget(Node* node) {
+    nodes_.erase(node->element);
+    for (auto& child : node->children) {
+        forget(child.get());
+    }
+}
+
+void ObjectTreeModel::renumber(Node* node, int from) {
+    for (int row = from; row < (int)node->children.size(); ++row) {
+        node->children[row]->row = row;
+    }
+}
+
+void ObjectTreeModel::removeTopLevel(const std::vector<CompositeElement*>& elements) {
+    // В списке могут быть и оставшиеся элементы (например, с измененным
+    // выделением); удаленные определяются по контейнеру, без разыменования
+    std::unordered_set<const CompositeElement*> gone;
+    for (auto element : elements) {
+        if (!container_->contains(element)) {
+            gone.insert(element);
+        }
+    }
+    if (gone.empty()) return;
+
+    // Загруженные строки убираются сигналами, смежными диапазонами снизу вверх
+    std::vector<int> rows;
+    for (auto element : gone) {
+        auto it = nodes_.find(element);
+        if (it != nodes_.end() && it->second->parent == &root_) {
+            rows.push_back(it->second->row);
+        }
+    }
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+
+    for (size_t i = 0; i < rows.size();) {
+        int last = rows[i];
+        int first = last;
+        for (++i; i < rows.size() && rows[i] == first - 1; ++i) {
+            first = rows[i];
+        }
+
+        beginRemoveRows(QModelIndex(), first, last);
+        for (int row = first; row <= last; ++row) {
+            forget(root_.children[row].get());
+        }
+        elementCount_ -= std::max(0, std::min(last + 1, elementCount_) - first);
+        root_.children.erase(root_.children.begin() + first, root_.children.begin() + last + 1);
+        topLevel_.erase(topLevel_.begin() + first, topLevel_.begin() + last + 1);
+        endRemoveRows();
+    }
+    if (!rows.empty()) {
+        renumber(&root_, rows.back());
+    }
+
+    // Незагруженная часть убирается одним проходом без сигналов
+    int loaded = (int)root_.children.size();
+    int write = loaded;
+    int removedElements = 0;
+    for (int read = loaded; read < (int)topLevel_.size(); ++read) {
+        if (gone.count(topLevel_[read])) {
+            if (read < elementCount_) ++removedElements;
+        } else {
+            topLevel_[write++] = topLevel_[read];
+        }
+    }
+    topLevel_.resize(write);
+    elementCount_ -= removedElements;
+}
+
+void ObjectTreeModel::insertTopLevel(int position, const std::vector<CompositeElement*>& elements) {
+    if (elements.empty()) return;
+
+    // За пределами загруженных строк элементы появятся при следующем fetchMore
+    int loaded = (int)root_.children.size();
+    if (position > loaded || (position == loaded && loaded < (int)topLevel_.size())) {
+        topLevel_.insert(topLevel_.begin() + position, elements.begin(), elements.end());
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), position, position + (int)elements.size() - 1);
+    topLevel_.insert(topLevel_.begin() + position, elements.begin(), elements.end());
+
+    std::vector<std::unique_ptr<Node>> created;
+    created.reserve(elements.size());
+    for (auto element : elements) {
+        auto node = std::make_unique<Node>();
+        node->element = element;
+        node->parent = &root_;
+        nodes_[element] = node.get();
+        created.push_back(std::move(node));
+    }
+    root_.children.insert(root_.children.begin() + position,
+                          std::make_move_iterator(created.begin()),
+                          std::make_move_iterator(created.end()));
+    renumber(&root_, position);
+    endInsertRows();
+}
+
+void ObjectTreeModel::appendFromContainer() {
+    // Контейнер добавляет элементы и стрелки в конец своих списков, поэтому
+    // новые - это хвосты, которых модель еще не видела
+    int knownArrows = (int)topLevel_.size() - elementCount_;
+    if (container_->getCount() < elementCount_ || container_->getArrowCount() < knownArrows) {
+        reload();
+        return;
+    }
+
+    std::vector<CompositeElement*> added;
+    for (int i = elementCount_; i < container_->getCount(); ++i) {
+        added.push_back(container_->getElement(i));
+    }
+    insertTopLevel(elementCount_, added);
+    elementCount_ += (int)added.size();
+
+    added.clear();
+    for (int i = knownArrows; i < container_->getArrowCount(); ++i) {
+        added.push_back(container_->getArrow(i));
+    }
+    insertTopLevel((int)topLevel_.size(), added);
+}
+
+void ObjectTreeModel::refreshSelection(const std::vector<CompositeElement*>& elements) {
+    const QList<int> roles = { Qt::ForegroundRole };
+
+    // Элементы не перечислены: обновляем все загруженные строки верхнего уровня
+    if (elements.empty()) {
+        if (!root_.children.empty()) {
+            emit dataChanged(index(0, 0), index((int)root_.children.size() - 1, 0), roles);
+        }
+        return;
+    }
+
+    for (auto element : elements) {
+        QModelIndex changed = indexOf(element);
+        if (changed.isValid()) {
+            emit dataChanged(changed, changed, roles);
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef OBJECTTREEMODEL_H
+#define OBJECTTREEMODEL_H
+
+#include <QAbstractItemModel>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "observer.h"
+
+class ShapeContainer;
+class CompositeElement;
+
+// Модель дерева объектов поверх ShapeContainer.
+// Верхний уровень - элементы документа, за ними стрелки; у групп дочерние
+// строки - их дети. Узлы строк создаются лениво порциями (canFetchMore/fetchMore),
+// поэтому стоимость зависит от числа показанных строк, а не от размера документа.
+// Изменения приходят свернутым ChangeSet и превращаются во вставку и удаление
+// строк; полный сброс модели - только при структурных изменениях (группировка,
+// загрузка, очистка).
+class ObjectTreeModel : public QAbstractItemModel {
+    Q_OBJECT
+
+public:
+    // Сколько строк загружается за один fetchMore
+    static const int FETCH_BATCH = 1000;
+
+    explicit ObjectTreeModel(QObject* parent = nullptr);
+    ~ObjectTreeModel();
+
+    void setContainer(ShapeContainer* container);
+    // Перечитывает верхний уровень из контейнера и сбрасывает модель
+    void reload();
+    // Применяет накопленные изменения контейнера
+    void applyChanges(const ChangeSet& changes);
+
+    // Элемент строки или nullptr
+    CompositeElement* elementAt(const QModelIndex& index) const;
+    // Индекс загруженной строки элемента; недействителен, если строка еще не загружена
+    QModelIndex indexOf(const CompositeElement* element) const;
+    // Число загруженных строк верхнего уровня
+    int loadedTopLevelCount() const { return (int)root_.children.size(); }
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& child) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+private:
+    // Загруженная строка. Дети загружаются префиксом: children[i] - i-й ребенок.
+    struct Node {
+        CompositeElement* element = nullptr;
+        Node* parent = nullptr;
+        int row = 0;
+        std::vector<std::unique_ptr<Node>> children;
+    };
+
+    ShapeContainer* container_;
+
+    // Верхний уровень: сначала элементы документа, затем стрелки
+    std::vector<CompositeElement*> topLevel_;
+    int elementCount_;
+
+    Node root_;
+    std::unordered_map<const CompositeElement*, Node*> nodes_;  // Только загруженные строки
+
+    Node* nodeOf(const QModelIndex& index) const;
+    int childCount(const Node* node) const;
+    CompositeElement* childElement(const Node* node, int row) const;
+    void forget(Node* node);
+    void renumber(Node* node, int from);
+
+    void removeTopLevel(const std::vector<CompositeElement*>& elements);
+    void insertTopLevel(int position, const std::vector<CompositeElement*>& elements);
+    void appendFromContainer();
+    void refreshSelection(const std::vector<CompositeElement*>& elements);
+};
+
+#endif // OBJECTTREEMODEL_H
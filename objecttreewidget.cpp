@@ -1,107 +1,137 @@
 #include "objecttreewidget.h"
-#include "mainwindow.h"
-#include "arrow.h"
-#include <QMouseEvent>
+#include "objecttreemodel.h"
+#include <QItemSelectionModel>
 
 ObjectTreeWidget::ObjectTreeWidget(QWidget* parent)
-    : QTreeWidget(parent), container_(nullptr), ignoreSelection_(false) {
-    setHeaderLabel("Объекты");
+    : QTreeView(parent), container_(nullptr), model_(new ObjectTreeModel(this)), ignoreSelection_(false), replaceSelection_(false) {
     setMinimumWidth(200);
     setMaximumWidth(300);
     setSelectionMode(QAbstractItemView::ExtendedSelection);
+    setSelectionBehavior(QAbstractItemView::SelectRows);
+    // Одинаковая высота строк: виду не нужно измерять каждую строку
+    setUniformRowHeights(true);
+    setModel(model_);
 
-    connect(this, &QTreeWidget::itemSelectionChanged,
-            this, &ObjectTreeWidget::onItemSelectionChanged);
+    connect(selectionModel(), &QItemSelectionModel::selectionChanged,
+            this, &ObjectTreeWidget::onSelectionChanged);
 }
 
 void ObjectTreeWidget::setContainer(ShapeContainer* container) {
+    if (container_) {
+        container_->removeObserver(this);
+    }
     container_ = container;
-    rebuildTree();
+    if (container_) {
+        container_->addObserver(this);
+    }
+
+    ignoreSelection_ = true;
+    model_->setContainer(container_);
+    ignoreSelection_ = false;
 }
 
-void ObjectTreeWidget::rebuildTree() {
-    clear();
-    if (!container_) return;
+void ObjectTreeWidget::updateChanges(const ChangeSet& changes) {
+    // Изменение пришло из самого дерева: строки уже выделены как надо
+    bool fromTree = ignoreSelection_;
 
-    for (int i = 0; i < container_->getCount(); ++i) {
-        CompositeElement* element = container_->getElement(i);
-        if (!element) continue;
+    // Удаление строк снимает с них выделение в виде; в контейнер это не передаем
+    ignoreSelection_ = true;
+    model_->applyChanges(changes);
+    ignoreSelection_ = fromTree;
 
-        QString text;
-        if (element->isGroup()) {
-            text = "Группа";
+    if (!fromTree && changes.has(EventKind::SelectionChanged)) {
+        if (changes.elements.empty()) {
+            syncSelectionFromContainer();
         } else {
-            if (auto adapter = dynamic_cast<ShapeAdapter*>(element)) {
-                text = QString::fromStdString(adapter->getTypeName());
-            } else {
-                text = "Объект";
-            }
+            syncSelection(changes.elements);
         }
-
-        QTreeWidgetItem* item = new QTreeWidgetItem(this);
-        item->setText(0, text);
-        item->setData(0, Qt::UserRole, i);
     }
-    expandAll();
-    syncSelectionFromContainer();
 }
 
 void ObjectTreeWidget::syncSelectionFromContainer() {
     if (!container_ || ignoreSelection_) return;
 
-    ignoreSelection_ = true;
+    std::vector<CompositeElement*> loaded;
+    loaded.reserve(model_->loadedTopLevelCount());
+    for (int row = 0; row < model_->loadedTopLevelCount(); ++row) {
+        loaded.push_back(model_->elementAt(model_->index(row, 0)));
+    }
+    syncSelection(loaded);
+}
 
-    for (int i = 0; i < container_->getCount(); ++i) {
-        CompositeElement* element = container_->getElement(i);
-        if (!element) continue;
-
-        // Ищем соответствующий элемент в дереве
-        for (int j = 0; j < topLevelItemCount(); ++j) {
-            QTreeWidgetItem* item = topLevelItem(j);
-            if (item->data(0, Qt::UserRole).toInt() == i) {
-                if (element->getSelected()) {
-                    item->setSelected(true);
-                    item->setForeground(0, QBrush(Qt::blue));
-                } else {
-                    item->setSelected(false);
-                    item->setForeground(0, QBrush(Qt::black));
-                }
-                break;
-            }
+void ObjectTreeWidget::syncSelection(const std::vector<CompositeElement*>& elements) {
+    QItemSelection selected;
+    QItemSelection deselected;
+    for (auto element : elements) {
+        // Строки удаленных и еще не загруженных элементов недействительны
+        QModelIndex index = model_->indexOf(element);
+        if (!index.isValid()) continue;
+
+        if (element->getSelected()) {
+            selected.select(index, index);
+        } else {
+            deselected.select(index, index);
         }
     }
 
+    ignoreSelection_ = true;
+    selectionModel()->select(deselected, QItemSelectionModel::Deselect | QItemSelectionModel::Rows);
+    selectionModel()->select(selected, QItemSelectionModel::Select | QItemSelectionModel::Rows);
     ignoreSelection_ = false;
 }
 
-void ObjectTreeWidget::onItemSelectionChanged() {
+void ObjectTreeWidget::rowsInserted(const QModelIndex& parent, int start, int end) {
+    QTreeView::rowsInserted(parent, start, end);
+    if (parent.isValid() || !container_ || ignoreSelection_) return;
+
+    // Только что загруженные строки получают выделение из контейнера
+    std::vector<CompositeElement*> inserted;
+    for (int row = start; row <= end; ++row) {
+        inserted.push_back(model_->elementAt(model_->index(row, 0)));
+    }
+    syncSelection(inserted);
+}
+
+void ObjectTreeWidget::onSelectionChanged(const QItemSelection& selected, const QItemSelection& deselected) {
     if (!container_ || ignoreSelection_) return;
 
     ignoreSelection_ = true;
 
-    // Снимаем выделение со всех объектов
-    for (int i = 0; i < container_->getCount(); ++i) {
-        if (auto e = container_->getElement(i)) {
-            e->setSelected(false);
+    if (replaceSelection_) {
+        // Вид знает только загруженные строки: выделение остальных элементов
+        // (например, после Ctrl+A) снимается в самом контейнере
+        replaceSelection_ = false;
+        container_->clearSelection();
+        for (const QModelIndex& index : selectionModel()->selectedRows()) {
+            if (auto e = model_->elementAt(index)) {
+                container_->setElementSelected(e, true);
+            }
         }
-    }
-
-    // Выделяем выбранные в дереве
-    for (auto* item : selectedItems()) {
-        int index = item->data(0, Qt::UserRole).toInt();
-        if (auto e = container_->getElement(index)) {
-            e->setSelected(true);
+    } else {
+        // Переносим в контейнер только изменившиеся строки
+        for (const QModelIndex& index : deselected.indexes()) {
+            if (auto e = model_->elementAt(index)) {
+                container_->setElementSelected(e, false);
+            }
+        }
+        for (const QModelIndex& index : selected.indexes()) {
+            if (auto e = model_->elementAt(index)) {
+                container_->setElementSelected(e, true);
+            }
         }
     }
 
     ignoreSelection_ = false;
 
-    // Обновляем отображение
-    if (auto* main = qobject_cast<MainWindow*>(window())) {
-        main->update();
-    }
+    // Изменения разошлются в кадре: модель перекрасит строки, окно
+    // перерисует только затронутую область. Повторная синхронизация вида
+    // при этом ничего не меняет - строки уже выделены.
+    emit frameRequested();
 }
 
-void ObjectTreeWidget::mousePressEvent(QMouseEvent* event) {
-    QTreeWidget::mousePressEvent(event);
+QItemSelectionModel::SelectionFlags ObjectTreeWidget::selectionCommand(const QModelIndex& index,
+                                                                        const QEvent* event) const {
+    QItemSelectionModel::SelectionFlags command = QTreeView::selectionCommand(index, event);
+    replaceSelection_ = (command & QItemSelectionModel::Clear) != 0;
+    return command;
 }
@@ -1,30 +1,50 @@
 #ifndef OBJECTTREEWIDGET_H
 #define OBJECTTREEWIDGET_H
 
-#include <QTreeWidget>
-#include <QTreeWidgetItem>
+#include <QTreeView>
+#include <QItemSelection>
 #include "shapecontainer.h"
+#include "observer.h"
 
-class Arrow;
+class ObjectTreeModel;
 
-class ObjectTreeWidget : public QTreeWidget {
+// Панель объектов: вид над ObjectTreeModel. Подписана на контейнер и
+// обновляется по свернутым изменениям; выделение синхронизируется только
+// для изменившихся строк.
+class ObjectTreeWidget : public QTreeView, public Observer {
     Q_OBJECT
 
 private:
     ShapeContainer* container_;
+    ObjectTreeModel* model_;
     bool ignoreSelection_;
+    // Последнее действие пользователя заменяет выделение целиком (щелчок без
+    // Ctrl/Shift): в контейнере снимается и выделение незагруженных строк
+    mutable bool replaceSelection_;
+
+    // Переносит выделение элементов из контейнера на строки вида
+    void syncSelection(const std::vector<CompositeElement*>& elements);
 
 public:
     explicit ObjectTreeWidget(QWidget* parent = nullptr);
     void setContainer(ShapeContainer* container);
-    void rebuildTree();
+    // Полная синхронизация выделения загруженных строк
     void syncSelectionFromContainer();
 
+    void updateChanges(const ChangeSet& changes) override;
+
+signals:
+    // Выделение изменено из дерева; изменения контейнера нужно разослать
+    // и перерисовать в ближайшем кадре
+    void frameRequested();
+
 protected:
-    void mousePressEvent(QMouseEvent* event) override;
+    void rowsInserted(const QModelIndex& parent, int start, int end) override;
+    QItemSelectionModel::SelectionFlags selectionCommand(const QModelIndex& index,
+                                                         const QEvent* event = nullptr) const override;
 
 private slots:
-    void onItemSelectionChanged();
+    void onSelectionChanged(const QItemSelection& selected, const QItemSelection& deselected);
 };
 
 #endif
@@ -1,14 +1,89 @@
 #ifndef OBSERVER_H
 #define OBSERVER_H
 
-#include <string>
+#include <QRect>
 #include <vector>
 #include <algorithm>
 
+class CompositeElement;
+
+// Виды событий. Значения - отдельные биты, чтобы набор изменений хранил
+// все произошедшие виды одной маской.
+enum class EventKind : unsigned {
+    GeometryChanged  = 1u << 0,  // Изменились положение или размер элемента
+    ElementAdded     = 1u << 1,
+    ElementRemoved   = 1u << 2,
+    ElementsMoved    = 1u << 3,
+    ElementsChanged  = 1u << 4,  // Изменилось оформление (цвет)
+    SelectionChanged = 1u << 5,
+    ContainerChanged = 1u << 6   // Изменилась структура: может измениться что угодно
+};
+
+// Одно событие, которое доставляется сразу (например, стрелке от ее конца)
+struct Event {
+    EventKind kind;
+    CompositeElement* element;  // Источник события
+};
+
+// Свернутый набор изменений за кадр или транзакцию: виды событий, затронутые
+// элементы и общая область перерисовки (в мировых координатах).
+// Удаленные элементы попадают в список только как идентификаторы, обращаться
+// к ним нельзя. Вид события без элементов значит, что элементы не перечислены. Если элементов слишком много, список не хранится, а в наборе
+// выставляется ContainerChanged.
+struct ChangeSet {
+    static const int MAX_ELEMENTS = 1024;
+
+    unsigned kinds = 0;
+    std::vector<CompositeElement*> elements;
+    QRect dirty;
+
+    bool empty() const { return kinds == 0; }
+    bool has(EventKind kind) const { return kinds & static_cast<unsigned>(kind); }
+
+    void add(EventKind kind, CompositeElement* element = nullptr) {
+        kinds |= static_cast<unsigned>(kind);
+        if (!element || has(EventKind::ContainerChanged)) return;
+
+        elements.push_back(element);
+        if ((int)elements.size() > 2 * MAX_ELEMENTS) {
+            compact();
+        }
+    }
+
+    void add(EventKind kind, const std::vector<CompositeElement*>& changed) {
+        kinds |= static_cast<unsigned>(kind);
+        for (auto element : changed) {
+            add(kind, element);
+        }
+    }
+
+    // Убирает повторы элементов; слишком длинный список заменяется на ContainerChanged
+    void compact() {
+        std::sort(elements.begin(), elements.end());
+        elements.erase(std::unique(elements.begin(), elements.end()), elements.end());
+        if ((int)elements.size() > MAX_ELEMENTS) {
+            kinds |= static_cast<unsigned>(EventKind::ContainerChanged);
+        }
+        if (has(EventKind::ContainerChanged)) {
+            elements.clear();
+        }
+    }
+
+    void clear() {
+        kinds = 0;
+        elements.clear();
+        dirty = QRect();
+    }
+};
+
 class Observer {
 public:
     virtual ~Observer() = default;
-    virtual void update(const std::string& eventType, void* data = nullptr) = 0;
+
+    // Немедленное событие от наблюдаемого объекта
+    virtual void update(const Event& event) { (void)event; }
+    // Свернутый набор изменений (рассылается раз в кадр)
+    virtual void updateChanges(const ChangeSet& changes) { (void)changes; }
 };
 
 class Observable {
@@ -31,9 +106,18 @@ public:
         }
     }
 
-    void notifyObservers(const std::string& eventType, void* data = nullptr) {
+    bool hasObservers() const { return !observers_.empty(); }
+    void clearObservers() { observers_.clear(); }
+
+    void notifyObservers(const Event& event) {
+        for (auto observer : observers_) {
+            observer->update(event);
+        }
+    }
+
+    void notifyObservers(const ChangeSet& changes) {
         for (auto observer : observers_) {
-            observer->update(eventType, data);
+            observer->updateChanges(changes);
         }
     }
 };
@@ -1,24 +1,30 @@
 #include "rectangle.h"
+#include "renderbatch.h"
+#include "hittest.h"
 
-Rectangle::Rectangle(int x, int y, int width, int height) : Shape(x, y), width_(width), height_(height) {}
+Rectangle::Rectangle(int x, int y, int width, int height) : Shape(x, y), width_(width), height_(height) {
+    updateRenderCache();
+}
 
 bool Rectangle::contains(int x, int y) const {
-    return (x >= x_ && x <= x_ + width_ && y >= y_ && y <= y_ + height_);
+    return HitTest::inRect(x, y, x_, y_, x_ + width_, y_ + height_);
 }
 
 void Rectangle::draw(QPainter &painter) const {
-    if (selected_) {
-        painter.setPen(QPen(Qt::blue, 2));
-        painter.setBrush(color_.lighter(150));
-    }
-    else {
-        painter.setPen(QPen(Qt::black, 1));
-        painter.setBrush(color_);
-    }
+    painter.setPen(style_->pen);
+    painter.setBrush(style_->brush);
 
     painter.drawRect(x_, y_, width_, height_);
 }
 
+void Rectangle::addToBatch(RenderBatch &batch) const {
+    batch.addRect(getBorderRect(), style_->pen, style_->brush);
+}
+
+void Rectangle::addToHitTest(HitTestBatch &batch, int id) const {
+    batch.addRect(id, x_, y_, x_ + width_, y_ + height_);
+}
+
 QRect Rectangle::getBorderRect() const {
     return QRect(x_, y_, width_, height_);
 }
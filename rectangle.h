@@ -13,6 +13,8 @@ public:
     Rectangle(int x, int y, int width = 50, int height = 30);
 
     void draw(QPainter &painter) const override;
+    void addToBatch(RenderBatch &batch) const override;
+    void addToHitTest(HitTestBatch &batch, int id) const override;
     bool contains(int x, int y) const override;
     QRect getBorderRect() const override;
 
@@ -0,0 +1,148 @@
+#include "renderbatch.h"
+#include <algorithm>
+
+void RenderBatch::addRect(const QRect& rect, const QPen& pen, const QBrush& brush)
+{
+    if (addSimplified(rect, pen, brush)) return;
+
+    Batch& batch = batchFor(RectPrimitive, pen, brush, strokeBounds(rect, pen));
+    batch.rects.push_back(rect);
+}
+
+void RenderBatch::addEllipse(const QRect& rect, const QPen& pen, const QBrush& brush)
+{
+    if (addSimplified(rect, pen, brush)) return;
+
+    Batch& batch = batchFor(PathPrimitive, pen, brush, strokeBounds(rect, pen));
+    batch.path.addEllipse(rect);
+}
+
+void RenderBatch::addPolygon(const QPolygon& polygon, const QPen& pen, const QBrush& brush)
+{
+    if (addSimplified(polygon.boundingRect(), pen, brush)) return;
+
+    Batch& batch = batchFor(PathPrimitive, pen, brush, strokeBounds(polygon.boundingRect(), pen));
+    batch.path.addPolygon(polygon);
+    batch.path.closeSubpath();
+}
+
+void RenderBatch::addLine(const QLine& line, const QPen& pen)
+{
+    QRect rect = QRect(line.p1(), line.p2()).normalized();
+    if (addSimplified(rect, pen, Qt::NoBrush)) return;
+
+    Batch& batch = batchFor(LinePrimitive, pen, Qt::NoBrush, strokeBounds(rect, pen));
+    batch.lines.push_back(line);
+}
+
+void RenderBatch::flush(QPainter& painter)
+{
+    painter.save();
+
+    for (const Batch& batch : batches_) {
+        painter.setPen(batch.pen);
+        painter.setBrush(batch.brush);
+
+        switch (batch.kind) {
+        case RectPrimitive:
+            painter.drawRects(batch.rects.data(), (int)batch.rects.size());
+            break;
+        case PathPrimitive:
+            painter.drawPath(batch.path);
+            break;
+        case LinePrimitive:
+            painter.drawLines(batch.lines.data(), (int)batch.lines.size());
+            break;
+        case PointPrimitive:
+            painter.drawPoints(batch.points.data(), (int)batch.points.size());
+            break;
+        }
+    }
+
+    painter.restore();
+    clear();
+}
+
+void RenderBatch::clear()
+{
+    batches_.clear();
+}
+
+RenderBatch::Batch& RenderBatch::batchFor(PrimitiveKind kind, const QPen& pen, const QBrush& brush, const QRect& bounds)
+{
+    int first = std::max(0, (int)batches_.size() - LOOKBACK);
+
+    for (int i = (int)batches_.size() - 1; i >= first; --i) {
+        Batch& batch = batches_[i];
+
+        if (batch.kind == kind && batch.pen == pen && batch.brush == brush) {
+            // Линии одним пером дают одинаковые пиксели в любом порядке,
+            // а заливаемые фигуры внутри пакета не должны перекрываться
+            if (kind == LinePrimitive || !overlapsItems(batch, bounds)) {
+                batch.bounds = batch.bounds.united(bounds);
+                batch.items.push_back(bounds);
+                return batch;
+            }
+            break;
+        }
+
+        // Нельзя опустить примитив ниже пакета, с которым он перекрывается
+        if (batch.bounds.intersects(bounds)) {
+            break;
+        }
+    }
+
+    Batch batch;
+    batch.kind = kind;
+    batch.pen = pen;
+    batch.brush = brush;
+    batch.bounds = bounds;
+    batch.items.push_back(bounds);
+    batches_.push_back(batch);
+    return batches_.back();
+}
+
+bool RenderBatch::addSimplified(const QRect& bounds, const QPen& pen, const QBrush& brush)
+{
+    if (detailScale_ >= 1.0) return false;
+
+    qreal width = bounds.width() * detailScale_;
+    qreal height = bounds.height() * detailScale_;
+    if (width >= LOD_PIXELS || height >= LOD_PIXELS) return false;
+
+    // Цвет метки берем из заливки, а у незалитых фигур - из пера
+    QColor color = brush.style() == Qt::NoBrush ? pen.color() : brush.color();
+
+    if (width < 1.0 && height < 1.0) {
+        // Перо нулевой толщины рисует ровно один пиксель при любом масштабе
+        Batch& batch = batchFor(PointPrimitive, QPen(color, 0), Qt::NoBrush, bounds);
+        batch.points.push_back(bounds.center());
+    } else {
+        Batch& batch = batchFor(RectPrimitive, Qt::NoPen, QBrush(color), bounds);
+        batch.rects.push_back(bounds);
+    }
+    return true;
+}
+
+bool RenderBatch::overlapsItems(const Batch& batch, const QRect& bounds)
+{
+    if (!batch.bounds.intersects(bounds)) {
+        return false;
+    }
+    if ((int)batch.items.size() > MAX_EXACT_OVERLAP_CHECK) {
+        return true;
+    }
+    for (const QRect& item : batch.items) {
+        if (item.intersects(bounds)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QRect RenderBatch::strokeBounds(const QRect& rect, const QPen& pen)
+{
+    // Перо выходит за геометрию примерно на половину своей толщины
+    int extra = pen.width() / 2 + 1;
+    return rect.adjusted(-extra, -extra, extra, extra);
+}
@@ -0,0 +1,84 @@
+#ifndef RENDERBATCH_H
+#define RENDERBATCH_H
+
+#include <QPainter>
+#include <QPainterPath>
+#include <QPen>
+#include <QBrush>
+#include <QRect>
+#include <QLine>
+#include <QPolygon>
+#include <vector>
+
+// Пакетная отрисовка примитивов.
+// Примитивы с одинаковым пером и кистью собираются в один пакет и рисуются
+// одним вызовом (drawRects, drawPath, drawLines). Примитив переносится в более
+// ранний пакет только если он не перекрывается ни с одним пакетом между ними
+// и ни с одним примитивом внутри пакета, поэтому z-порядок перекрывающихся
+// фигур остается прежним.
+// При отдалении фигуры меньше LOD_PIXELS пикселей заменяются упрощенными
+// метками: залитым прямоугольником или точкой.
+class RenderBatch
+{
+public:
+    // Размер фигуры на экране, ниже которого она рисуется упрощенно
+    static const int LOD_PIXELS = 4;
+
+    RenderBatch() = default;
+
+    // Масштаб мир -> экран, по которому выбирается уровень детализации
+    void setDetailScale(qreal scale) { detailScale_ = scale; }
+
+    // Видимая область в мировых координатах. Составные элементы (группы)
+    // добавляют только детей, задевающих ее; пустой прямоугольник - без отсечения
+    void setCullRect(const QRect& rect) { cullRect_ = rect; }
+    const QRect& cullRect() const { return cullRect_; }
+
+    void addRect(const QRect& rect, const QPen& pen, const QBrush& brush);
+    void addEllipse(const QRect& rect, const QPen& pen, const QBrush& brush);
+    void addPolygon(const QPolygon& polygon, const QPen& pen, const QBrush& brush);
+    void addLine(const QLine& line, const QPen& pen);
+
+    // Рисует все накопленные пакеты и очищает очередь
+    void flush(QPainter& painter);
+    void clear();
+
+    int batchCount() const { return (int)batches_.size(); }
+
+private:
+    enum PrimitiveKind {
+        RectPrimitive,
+        PathPrimitive,
+        LinePrimitive,
+        PointPrimitive
+    };
+
+    struct Batch {
+        PrimitiveKind kind;
+        QPen pen;
+        QBrush brush;
+        QRect bounds;                 // Объединение границ всех примитивов пакета
+        std::vector<QRect> items;     // Границы отдельных примитивов
+        std::vector<QRect> rects;
+        std::vector<QLine> lines;
+        std::vector<QPoint> points;
+        QPainterPath path;
+    };
+
+    // Сколько пакетов назад просматривать при поиске подходящего
+    static const int LOOKBACK = 8;
+    // Выше этого размера точная проверка перекрытия внутри пакета не выполняется
+    static const int MAX_EXACT_OVERLAP_CHECK = 64;
+
+    std::vector<Batch> batches_;
+    qreal detailScale_ = 1.0;
+    QRect cullRect_;
+
+    bool addSimplified(const QRect& bounds, const QPen& pen, const QBrush& brush);
+
+    Batch& batchFor(PrimitiveKind kind, const QPen& pen, const QBrush& brush, const QRect& bounds);
+    static bool overlapsItems(const Batch& batch, const QRect& bounds);
+    static QRect strokeBounds(const QRect& rect, const QPen& pen);
+};
+
+#endif // RENDERBATCH_H
@@ -0,0 +1,215 @@
+// Пакетная отрисовка сохраненных документов в PNG без окон и виджетов.
+//
+// Использование:
+//   laba6-render <файл|каталог> <каталог для PNG> [--size ШxВ] [--scale S] [--threads N]
+//
+// Без --scale документ целиком вписывается в изображение заданного размера.
+// Каталог обрабатывается параллельно: каждый документ загружается и рисуется
+// целиком в одном рабочем потоке, поэтому фигуры разных документов не делятся
+// между потоками. Для каждого файла печатается время загрузки и отрисовки.
+
+#include "shapecontainer.h"
+#include "renderbatch.h"
+#include "viewport.h"
+#include "arrow.h"
+#include <QGuiApplication>
+#include <QImage>
+#include <QPainter>
+#include <QDir>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QThread>
+#include <QStringList>
+#include <cstdio>
+#include <exception>
+#include <vector>
+
+namespace {
+
+const int FIT_MARGIN = 10;
+
+struct RenderOptions {
+    QSize size = QSize(1024, 768);
+    qreal scale = 0;  // 0 - вписать документ в изображение
+    int threads = QThread::idealThreadCount();
+};
+
+struct RenderJob {
+    QString input;
+    QString output;
+    bool ok = false;
+    int elementCount = 0;
+    qint64 loadNs = 0;
+    qint64 renderNs = 0;
+};
+
+void renderDocument(RenderJob& job, const RenderOptions& options)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    ShapeContainer shapes;
+    if (!shapes.loadFromFile(job.input.toStdString())) {
+        return;
+    }
+    job.elementCount = shapes.getCount();
+    job.loadNs = timer.nsecsElapsed();
+
+    timer.restart();
+
+    Viewport viewport;
+    QRect content = shapes.contentRect();
+    if (options.scale > 0) {
+        // Масштаб задан явно: левый верхний угол содержимого в начале изображения
+        viewport.zoomAt(options.scale, QPointF(0, 0));
+        viewport.panBy(-QPointF(content.topLeft()) * viewport.zoom());
+    } else {
+        viewport.fitTo(content, options.size, FIT_MARGIN);
+    }
+
+    QImage image(options.size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+
+    QPainter painter(&image);
+    painter.setTransform(viewport.transform());
+
+    QRect area = viewport.mapToWorld(QRect(QPoint(0, 0), options.size));
+
+    RenderBatch batch;
+    batch.setDetailScale(viewport.zoom());
+    batch.setCullRect(area);
+    for (CompositeElement* element : shapes.findElementsInRect(area)) {
+        element->addToBatch(batch);
+    }
+    for (Arrow* arrow : shapes.findArrowsInRect(area)) {
+        arrow->addToBatch(batch);
+    }
+    batch.flush(painter);
+    painter.end();
+
+    job.ok = image.save(job.output, "PNG");
+    job.renderNs = timer.nsecsElapsed();
+}
+
+bool parseSize(const QString& text, QSize& size)
+{
+    QStringList parts = text.split('x');
+    if (parts.size() != 2) return false;
+
+    bool okWidth = false;
+    bool okHeight = false;
+    int width = parts[0].toInt(&okWidth);
+    int height = parts[1].toInt(&okHeight);
+    if (!okWidth || !okHeight || width <= 0 || height <= 0) return false;
+
+    size = QSize(width, height);
+    return true;
+}
+
+void printUsage()
+{
+    std::fprintf(stderr, "Usage: laba6-render <file|dir> <output dir> "
+                         "[--size WxH] [--scale S] [--threads N]\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Экран не нужен: на серверах сборки дисплея может не быть
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+
+    QStringList args = QCoreApplication::arguments();
+    QStringList positional;
+    RenderOptions options;
+
+    for (int i = 1; i < args.size(); ++i) {
+        const QString& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+
+        if (arg == "--size" && hasValue) {
+            if (!parseSize(args[++i], options.size)) {
+                printUsage();
+                return 1;
+            }
+        } else if (arg == "--scale" && hasValue) {
+            options.scale = args[++i].toDouble();
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = qMax(1, args[++i].toInt());
+        } else if (arg.startsWith("--")) {
+            printUsage();
+            return 1;
+        } else {
+            positional << arg;
+        }
+    }
+
+    if (positional.size() != 2) {
+        printUsage();
+        return 1;
+    }
+
+    QFileInfo input(positional[0]);
+    QDir outputDir(positional[1]);
+    if (!outputDir.exists() && !outputDir.mkpath(".")) {
+        std::fprintf(stderr, "Cannot create output directory: %s\n", qPrintable(positional[1]));
+        return 1;
+    }
+
+    QStringList files;
+    if (input.isDir()) {
+        QDir dir(input.absoluteFilePath());
+        for (const QString& name : dir.entryList(QStringList() << "*.txt", QDir::Files, QDir::Name)) {
+            files << dir.absoluteFilePath(name);
+        }
+    } else {
+        files << input.absoluteFilePath();
+    }
+
+    std::vector<RenderJob> jobs(files.size());
+    for (int i = 0; i < files.size(); ++i) {
+        jobs[i].input = files[i];
+        jobs[i].output = outputDir.absoluteFilePath(QFileInfo(files[i]).completeBaseName() + ".png");
+    }
+
+    QElapsedTimer total;
+    total.start();
+
+    // Один документ на задачу; результаты пишутся каждый в свою ячейку
+    QThreadPool pool;
+    pool.setMaxThreadCount(options.threads);
+    for (RenderJob& job : jobs) {
+        RenderJob* target = &job;
+        pool.start([target, &options]() {
+            // Исключение в задаче пула завершило бы весь процесс: документ
+            // с ошибкой просто отмечается как неудавшийся
+            try {
+                renderDocument(*target, options);
+            } catch (const std::exception& e) {
+                target->ok = false;
+                std::fprintf(stderr, "%s: %s\n", qPrintable(target->input), e.what());
+            }
+        });
+    }
+    pool.waitForDone();
+
+    int failed = 0;
+    for (const RenderJob& job : jobs) {
+        if (job.ok) {
+            std::printf("%-40s %6d elements  load %8.2f ms  render %8.2f ms\n",
+                        qPrintable(QFileInfo(job.input).fileName()), job.elementCount,
+                        job.loadNs / 1e6, job.renderNs / 1e6);
+        } else {
+            std::printf("%-40s FAILED\n", qPrintable(QFileInfo(job.input).fileName()));
+            failed++;
+        }
+    }
+    std::printf("%d documents, %d failed, %d threads, %.2f ms total\n",
+                (int)jobs.size(), failed, options.threads, total.nsecsElapsed() / 1e6);
+
+    return failed == 0 ? 0 : 2;
+}
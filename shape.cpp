@@ -1,10 +1,11 @@
 #include "shape.h"
 
-Shape::Shape(int x, int y) : x_(x), y_(y), color_(Qt::red), selected_(false) {}
+Shape::Shape(int x, int y) : x_(x), y_(y), selected_(false), style_(nullptr) {}
 
 void Shape::move(int dx, int dy) {
     x_ += dx;
     y_ += dy;
+    updateGeometry();
 }
 
 QRect Shape::getSafeBorderRect(int margin) const {
@@ -43,15 +44,28 @@ bool Shape::getSelected() const {
 }
 
 void Shape::setSelected(bool selected) {
+    if (selected_ == selected) return;
     selected_ = selected;
+    // Парная запись уже есть, палитру опрашивать не нужно
+    style_ = selected_ ? style_->selected : style_->normal;
 }
 
 QColor Shape::getColor() const {
-    return color_;
+    return QColor::fromRgba(style_->color);
 }
 
 void Shape::setColor(const QColor &color) {
-    color_ = color;
+    QRgb rgba = color.rgba();
+    if (style_->color == rgba) return;
+    updateStyle(rgba);
+}
+
+void Shape::adoptPalette(StylePalette& palette) {
+    if (!style_ || style_->palette == &palette) return;
+    style_ = palette.intern(style_->color, styleKey(false), styleKey(true));
+    if (selected_) {
+        style_ = style_->selected;
+    }
 }
 
 int Shape::getX() const {
@@ -65,4 +79,31 @@ int Shape::getY() const {
 void Shape::setPosition(int x, int y) {
     x_ = x;
     y_ = y;
+    updateGeometry();
+}
+
+StyleKey Shape::styleKey(bool selected) const {
+    if (selected) {
+        return StyleKey::outline(qRgb(0, 0, 255), 2, ColorRole::LighterShape);
+    }
+    return StyleKey::outline(qRgb(0, 0, 0), 1, ColorRole::Shape);
+}
+
+void Shape::updateStyle() {
+    // До первого пересчета у фигуры цвет по умолчанию
+    updateStyle(style_ ? style_->color : qRgb(255, 0, 0));
+}
+
+void Shape::updateStyle(QRgb color) {
+    // Фигура остается в палитре, из которой получила первую запись
+    StylePalette& palette = style_ ? *style_->palette : StylePalette::current();
+    style_ = palette.intern(color, styleKey(false), styleKey(true));
+    if (selected_) {
+        style_ = style_->selected;
+    }
+}
+
+void Shape::updateRenderCache() {
+    updateStyle();
+    updateGeometry();
 }
@@ -4,20 +4,31 @@
 #include <QPainter>
 #include <QRect>
 #include <QColor>
+#include "stylepalette.h"
+
+class RenderBatch;
+class HitTestBatch;
 
 class Shape
 {
 protected:
     int x_;
     int y_;
-    QColor color_;
     bool selected_;
 
+    // Перо и кисть из палитры документа; запись хранит и цвет фигуры. Выделение
+    // переключает на парную запись, палитра опрашивается только при смене
+    // цвета или параметров оформления, при рисовании ничего не создается
+    const ShapeStyle* style_;
+
 public:
     Shape(int x, int y);
     virtual ~Shape() = default;
 
     virtual void draw(QPainter &painter) const = 0;
+    virtual void addToBatch(RenderBatch &batch) const = 0;
+    // Добавляет точную геометрию фигуры для пакетной проверки попадания
+    virtual void addToHitTest(HitTestBatch &batch, int id) const = 0;
     virtual bool contains(int x, int y) const = 0;
     virtual QRect getBorderRect() const = 0;
     virtual QRect getSafeBorderRect(int margin = 0) const;
@@ -34,9 +45,25 @@ public:
     QColor getColor() const;
     void setColor(const QColor& color);
 
+    // Переводит фигуру на записи палитры документа, если она создана вне его
+    void adoptPalette(StylePalette& palette);
+
     int getX() const;
     int getY() const;
     void setPosition(int x, int y);
+
+protected:
+    // Оформление фигуры в обычном и выделенном виде; вместе с цветом
+    // по нему из палитры выбирается пара записей для style_
+    virtual StyleKey styleKey(bool selected) const;
+
+    // Пересчет кэша отрисовки. Вызывается из конструкторов наследников
+    // (в конструкторе Shape виртуальные методы наследника еще недоступны)
+    // и из методов, меняющих соответствующие свойства.
+    void updateStyle();
+    void updateStyle(QRgb color);
+    virtual void updateGeometry() {}
+    void updateRenderCache();
 };
 
 #endif // SHAPE_H
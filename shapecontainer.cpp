@@ -2,179 +2,316 @@
 #include "shapefactory.h"
 #include "group.h"
 #include "arrow.h"
+#include "hittest.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_set>
 #include <QDebug>
 
-ShapeContainer::ShapeContainer() : arrowSource_(nullptr) {}
+ShapeContainer::ShapeContainer()
+    : arrowSource_(nullptr), nextOrder_(0), backgroundRevision_(0), backgroundFull_(true),
+      transactionDepth_(0), removedSlots_(0) {}
 
 ShapeContainer::~ShapeContainer() {
+    // Подписчики могут быть уже уничтожены, очистку им не рассылаем
+    clearObservers();
     clear();
 }
 
 void ShapeContainer::addElement(CompositeElement* element) {
     if (element != nullptr) {
+        // Фигуры, созданные вне документа, переходят на его палитру
+        element->adoptPalette(palette_);
         elements_.push_back(element);
-        qDebug() << "ShapeContainer::addElement - notifying";
-        notifyObservers("element_added", element);
+        indexElement(element);
+        QRect damage = damageRect(element);
+        markDirty(damage);
+        invalidateBackground(damage);
+        notifyChanged(EventKind::ElementAdded, element);
     }
 }
 
 void ShapeContainer::removeElement(int i) {
-    if (i >= 0 && i < (int)elements_.size()) {
-        delete elements_[i];
-        elements_.erase(elements_.begin() + i);
-        notifyObservers("element_removed");
+    if (i >= 0 && i < (int)elements_.size() && elements_[i]) {
+        QRect damage = damageRectWithArrows({elements_[i]});
+        markDirty(damage);
+        removeArrowsWithElement(elements_[i]);
+        unindexElement(elements_[i]);
+        notifyRemoved(elements_[i]);
+        retire(elements_[i]);
+        if (inTransaction()) {
+            // Слот освобождается при завершении транзакции, индексы не сдвигаются
+            elements_[i] = nullptr;
+            ++removedSlots_;
+        } else {
+            // Одиночное удаление: читатели вне транзакции не ждут пустых слотов
+            elements_.erase(elements_.begin() + i);
+        }
+        invalidateBackground(damage);
+        flushRemovals();
     }
 }
 
-void ShapeContainer::clear() {
-    for (auto element : elements_) {
+void ShapeContainer::beginTransaction() {
+    ++transactionDepth_;
+}
+
+void ShapeContainer::commitTransaction() {
+    if (transactionDepth_ == 0 || --transactionDepth_ > 0) return;
+
+    compactElements();
+    // Все изменения транзакции уходят подписчикам одним уведомлением,
+    // не дожидаясь кадра: загрузчики и laba6-render кадров не имеют
+    flushChanges();
+}
+
+void ShapeContainer::reserve(int elements, int arrows) {
+    elements_.reserve(elements_.size() + elements);
+    store_.reserve(store_.size() + elements);
+    arrows_.reserve(arrows_.size() + arrows);
+    arrowSlots_.reserve(arrowSlots_.size() + arrows);
+}
+
+void ShapeContainer::notifyChanged(EventKind kind, CompositeElement* element) {
+    pending_.add(kind, element);
+}
+
+void ShapeContainer::notifyChanged(EventKind kind, const std::vector<CompositeElement*>& elements) {
+    pending_.add(kind, elements);
+}
+
+void ShapeContainer::notifyRemoved(CompositeElement* element) {
+    removals_.add(EventKind::ElementRemoved, element);
+}
+
+void ShapeContainer::notifyRemoved(const std::vector<CompositeElement*>& elements) {
+    removals_.add(EventKind::ElementRemoved, elements);
+}
+
+void ShapeContainer::retire(CompositeElement* element) {
+    retired_.push_back(element);
+}
+
+void ShapeContainer::flushRemovals() {
+    if (inTransaction()) return;
+
+    if (!removals_.empty()) {
+        ChangeSet changes;
+        std::swap(changes, removals_);
+
+        // Еще не разосланные добавления уходят вместе с удалениями: дерево
+        // находит новые объекты по хвостам списков контейнера, а удаление
+        // стрелки переставляет последнюю на ее место
+        if (pending_.has(EventKind::ElementAdded) || pending_.has(EventKind::ContainerChanged)) {
+            changes.kinds |= pending_.kinds;
+            changes.elements.insert(changes.elements.end(), pending_.elements.begin(), pending_.elements.end());
+            changes.dirty = changes.dirty.united(pending_.dirty);
+            pending_.clear();
+        }
+        changes.compact();
+        notifyObservers(changes);
+    }
+    releaseRetired();
+}
+
+void ShapeContainer::releaseRetired() {
+    // Стрелки попадают в список раньше своих концов: в деструкторе
+    // они отписываются от них
+    std::vector<CompositeElement*> retired;
+    std::swap(retired, retired_);
+    for (auto element : retired) {
         delete element;
     }
-    elements_.clear();
+}
 
-    for (auto arrow : arrows_) {
+void ShapeContainer::flushChanges() {
+    // Удаления уходят первыми, чтобы подписчики не держали освобожденных объектов
+    flushRemovals();
+    if (inTransaction() || pending_.empty()) return;
+
+    // Подписчик может снова изменить контейнер, поэтому рассылаем копию
+    ChangeSet changes;
+    std::swap(changes, pending_);
+    changes.compact();
+    notifyObservers(changes);
+}
+
+void ShapeContainer::compactElements() {
+    if (removedSlots_ == 0) return;
+    elements_.erase(std::remove(elements_.begin(), elements_.end(), nullptr), elements_.end());
+    removedSlots_ = 0;
+}
+
+void ShapeContainer::clear() {
+    std::vector<Arrow*> arrows;
+    std::swap(arrows, arrows_);
+    for (auto arrow : arrows) {
+        markDirty(damageRect(arrow));
+    }
+    arrowSlots_.clear();
+    incidence_.clear();
+    selectedArrows_.clear();
+
+    std::vector<CompositeElement*> elements;
+    std::swap(elements, elements_);
+    for (auto element : elements) {
+        markDirty(damageRect(element));
+    }
+    removedSlots_ = 0;
+
+    elementIndex_.clear();
+    arrowIndex_.clear();
+    store_.clear();
+    invalidateBackground();
+
+    // Подписчики забывают все объекты до их удаления. Очистка рассылается
+    // сразу, даже внутри транзакции: иначе память старого документа
+    // держалась бы до конца загрузки нового.
+    ChangeSet changes;
+    std::swap(changes, pending_);
+    removals_.clear();
+    changes.add(EventKind::ContainerChanged);
+    changes.compact();
+    notifyObservers(changes);
+
+    // Стрелки удаляем первыми: в деструкторе они отписываются от своих концов
+    for (auto arrow : arrows) {
         delete arrow;
     }
-    arrows_.clear();
+    for (auto element : elements) {
+        delete element;
+    }
+    releaseRetired();
 
-    notifyObservers("container_changed");
+    // Все объекты удалены, память загруженного документа возвращается одним
+    // вызовом. Если какой-то объект из арены еще жив (например, удержан вне
+    // контейнера), буфер остается до следующей очистки или деструктора.
+    if (arena_.liveCount() == 0) {
+        arena_.release();
+    }
+    palette_.clear();
 }
 
 void ShapeContainer::clearSelection() {
     qDebug() << "ShapeContainer::clearSelection";
 
-    std::vector<CompositeElement*> toClear;
-    for (auto element : elements_) {
-        if (element && element->getSelected()) {
-            toClear.push_back(element);
-        }
-    }
+    bool changed = store_.selectedCount() > 0 || !selectedArrows_.empty();
 
-    for (auto element : toClear) {
+    QRect damage;
+    for (auto element : store_.selection()) {
         element->setSelected(false);
+        damage = damage.united(damageRectWithArrows({element}));
+        notifyChanged(EventKind::SelectionChanged, element);
     }
+    store_.clearSelection();
 
-    for (auto arrow : arrows_) {
-        if (arrow && arrow->getSelected()) {
-            arrow->setSelected(false);
-        }
+    for (auto arrow : selectedArrows_) {
+        arrow->setSelected(false);
+        damage = damage.united(damageRect(arrow));
+        notifyChanged(EventKind::SelectionChanged, arrow);
     }
+    selectedArrows_.clear();
+    markDirty(damage);
 
-    if (!toClear.empty()) {
-        notifyObservers("selection_changed");
+    if (changed) {
+        // Снятые с выделения элементы (и их стрелки) переходят в фоновый слой
+        invalidateBackground(damage);
     }
 }
 
-void ShapeContainer::removeSelected() {
-    qDebug() << "\n=== removeSelected ===";
-    qDebug() << "Elements before:" << elements_.size();
-    for (size_t i = 0; i < elements_.size(); i++) {
-        qDebug() << "  Element" << i << ":" << elements_[i] << "selected:" << elements_[i]->getSelected();
-    }
+void ShapeContainer::setElementSelected(CompositeElement* element, bool selected) {
+    if (!element) return;
 
-    qDebug() << "Arrows before:" << arrows_.size();
-    for (size_t i = 0; i < arrows_.size(); i++) {
-        qDebug() << "  Arrow" << i << ":" << arrows_[i]
-                 << "source:" << arrows_[i]->getSource()
-                 << "target:" << arrows_[i]->getTarget()
-                 << "selected:" << arrows_[i]->getSelected();
-    }
+    if (element->kind() == ShapeKind::Arrow) {
+        Arrow* arrow = static_cast<Arrow*>(element);
+        auto it = std::find(selectedArrows_.begin(), selectedArrows_.end(), arrow);
+        if ((it != selectedArrows_.end()) == selected) return;
 
-    // Сначала собираем все элементы для удаления
-    std::vector<CompositeElement*> toDelete;
-    for (auto element : elements_) {
-        if (element && element->getSelected()) {
-            toDelete.push_back(element);
-            qDebug() << "  Will delete element:" << element;
+        if (selected) {
+            selectedArrows_.push_back(arrow);
+        } else {
+            *it = selectedArrows_.back();
+            selectedArrows_.pop_back();
         }
+    } else if (!store_.setSelected(element, selected)) {
+        return;
     }
 
-    if (toDelete.empty()) {
-        qDebug() << "No elements to delete";
-    }
+    // Для группы меняется только ее собственный флаг, дети не перебираются
+    element->setSelected(selected);
+    invalidateElement(element);
+    notifyChanged(EventKind::SelectionChanged, element);
+}
 
-    // Удаляем все стрелки, связанные с этими элементами
-    qDebug() << "Checking arrows for deletion...";
-    for (int i = arrows_.size() - 1; i >= 0; i--) {
-        Arrow* arrow = arrows_[i];
-        bool shouldDelete = false;
+bool ShapeContainer::contains(const CompositeElement* element) const {
+    // Элемент не разыменовывается: адрес может принадлежать уже удаленному
+    if (store_.rowOf(element) >= 0) return true;
+    return arrowSlots_.count(static_cast<const Arrow*>(element)) > 0;
+}
 
-        qDebug() << "  Arrow" << i << "source:" << arrow->getSource() << "target:" << arrow->getTarget();
+bool ShapeContainer::isElementSelected(const CompositeElement* element) const {
+    int row = store_.rowOf(element);
+    return row >= 0 && store_.isSelected(row);
+}
 
-        for (auto element : toDelete) {
-            if (arrow->getSource() == element) {
-                qDebug() << "    Source matches element" << element;
-                shouldDelete = true;
-                break;
-            }
-            if (arrow->getTarget() == element) {
-                qDebug() << "    Target matches element" << element;
-                shouldDelete = true;
-                break;
-            }
-        }
+void ShapeContainer::removeSelected() {
+    // Сначала собираем все элементы для удаления
+    std::vector<CompositeElement*> toDelete = store_.selectedElements();
 
-        if (shouldDelete) {
-            qDebug() << "  DELETING arrow" << i;
-            delete arrow;
-            arrows_.erase(arrows_.begin() + i);
-        } else {
-            qDebug() << "  Keeping arrow" << i;
-        }
-    }
+    // Запоминаем область удаляемых элементов вместе со стрелками до удаления
+    QRect damage = damageRectWithArrows(toDelete);
 
-    // Удаляем выбранные стрелки
-    qDebug() << "Checking for selected arrows...";
-    for (int i = arrows_.size() - 1; i >= 0; i--) {
-        if (arrows_[i]->getSelected()) {
-            qDebug() << "Deleting selected arrow:" << arrows_[i];
-            delete arrows_[i];
-            arrows_.erase(arrows_.begin() + i);
+    // Удаляем стрелки, связанные с этими элементами, и выбранные стрелки
+    std::vector<Arrow*> toUnlink = incidentArrows(toDelete);
+    for (auto arrow : selectedArrows_) {
+        if (!isElementSelected(arrow->getSource()) && !isElementSelected(arrow->getTarget())) {
+            damage = damage.united(damageRect(arrow));
+            toUnlink.push_back(arrow);
         }
     }
+    markDirty(damage);
+    for (auto arrow : toUnlink) {
+        unlinkArrow(arrow);
+    }
 
-    // Удаляем элементы
-    qDebug() << "Deleting elements...";
+    // Удаляем элементы одним проходом, сохраняя порядок остальных
+    elements_.erase(std::remove_if(elements_.begin(), elements_.end(), [this](CompositeElement* element) {
+        return isElementSelected(element);
+    }), elements_.end());
     for (auto element : toDelete) {
-        for (int i = elements_.size() - 1; i >= 0; i--) {
-            if (elements_[i] == element) {
-                qDebug() << "Deleting element:" << element;
-                delete elements_[i];
-                elements_.erase(elements_.begin() + i);
-                break;
-            }
-        }
+        unindexElement(element);
+        retire(element);
     }
 
-    qDebug() << "Elements after:" << elements_.size();
-    qDebug() << "Arrows after:" << arrows_.size();
-    for (size_t i = 0; i < arrows_.size(); i++) {
-        qDebug() << "  Arrow" << i << ":" << arrows_[i]
-                 << "source:" << arrows_[i]->getSource()
-                 << "target:" << arrows_[i]->getTarget();
-    }
-    qDebug() << "=== removeSelected finished ===\n";
+    invalidateBackground(damage);
 
-    notifyObservers("element_removed");
+    // Дерево убирает строки до освобождения элементов
+    notifyRemoved(toDelete);
+    flushRemovals();
 }
 
 void ShapeContainer::selectAll() {
     qDebug() << "ShapeContainer::selectAll";
     for (auto element : elements_) {
+        if (!element) continue;
         element->setSelected(true);
+        markDirty(damageRect(element));
     }
+    store_.selectAll();
     for (auto arrow : arrows_) {
         arrow->setSelected(true);
+        markDirty(damageRect(arrow));
     }
-    notifyObservers("selection_changed");
+    selectedArrows_ = arrows_;
+    invalidateBackground();
+    notifyChanged(EventKind::SelectionChanged);
 }
 
 void ShapeContainer::notifySelectionChanged() {
     qDebug() << "CONTAINER: notifySelectionChanged()";
-    notifyObservers("selection_changed");
+    invalidateBackground();
+    notifyChanged(EventKind::SelectionChanged);
 }
 
 CompositeElement* ShapeContainer::getElement(int i) const {
@@ -189,32 +326,15 @@ int ShapeContainer::getCount() const {
 }
 
 std::vector<CompositeElement*> ShapeContainer::getSelectedElements() const {
-    std::vector<CompositeElement*> selected;
-    for (auto element : elements_) {
-        if (element && element->getSelected()) {
-            selected.push_back(element);
-        }
-    }
-    return selected;
+    return store_.selectedElements();
 }
 
 bool ShapeContainer::hasSelectedElements() const {
-    for (auto element : elements_) {
-        if (element && element->getSelected()) {
-            return true;
-        }
-    }
-    return false;
+    return store_.selectedCount() > 0;
 }
 
 int ShapeContainer::getSelectedCount() const {
-    int count = 0;
-    for (auto element : elements_) {
-        if (element && element->getSelected()) {
-            count++;
-        }
-    }
-    return count;
+    return store_.selectedCount();
 }
 
 void ShapeContainer::groupSelected() {
@@ -227,55 +347,42 @@ void ShapeContainer::groupSelected() {
     qDebug() << "=== groupSelected ===";
     qDebug() << "Selected elements:" << selected.size();
 
-    // Сохраняем все стрелки, которые связаны с выбранными элементами
-    std::vector<Arrow*> arrowsToRemove;
+    QRect damage = damageRectWithArrows(selected);
+    markDirty(damage);
+
+    // Сохраняем все стрелки, которые связаны с выбранными элементами:
+    // они будут пересозданы и поведут от/к группе
+    std::vector<Arrow*> arrowsToRemove = incidentArrows(selected);
     std::vector<std::tuple<CompositeElement*, CompositeElement*, bool>> arrowsToRecreate;
 
-    for (auto arrow : arrows_) {
-        CompositeElement* source = arrow->getSource();
-        CompositeElement* target = arrow->getTarget();
-
-        bool sourceInGroup = (std::find(selected.begin(), selected.end(), source) != selected.end());
-        bool targetInGroup = (std::find(selected.begin(), selected.end(), target) != selected.end());
-
-        // Если оба конца стрелки попадают в группу - стрелка останется внутри группы
-        if (sourceInGroup && targetInGroup) {
-            qDebug() << "Arrow both ends in group - will be inside group";
-            arrowsToRemove.push_back(arrow);
-            // Внутри группы стрелка сохранится, но мы ее потом пересоздадим
-            arrowsToRecreate.push_back({source, target, arrow->isBidirectional()});
-        }
-        // Если только один конец в группе - стрелка будет вести от/к группе
-        else if (sourceInGroup || targetInGroup) {
-            qDebug() << "Arrow one end in group - will be recreated with group";
-            arrowsToRemove.push_back(arrow);
-            arrowsToRecreate.push_back({source, target, arrow->isBidirectional()});
-        }
+    for (auto arrow : arrowsToRemove) {
+        arrowsToRecreate.push_back({arrow->getSource(), arrow->getTarget(), arrow->isBidirectional()});
     }
 
     // Удаляем старые стрелки
     for (auto arrow : arrowsToRemove) {
-        auto it = std::find(arrows_.begin(), arrows_.end(), arrow);
-        if (it != arrows_.end()) {
-            delete *it;
-            arrows_.erase(it);
-        }
+        unlinkArrow(arrow);
     }
 
     Group* newGroup = new Group();
 
+    // Выбранные элементы переходят в группу одним проходом по elements_
+    elements_.erase(std::remove_if(elements_.begin(), elements_.end(), [this](CompositeElement* element) {
+        return isElementSelected(element);
+    }), elements_.end());
     for (auto element : selected) {
-        for (int i = (int)elements_.size() - 1; i >= 0; i--) {
-            if (elements_[i] == element) {
-                newGroup->addChild(element);
-                elements_.erase(elements_.begin() + i);
-                break;
-            }
-        }
+        // Выделена теперь группа, а не ее дети
+        unindexElement(element);
+        element->setSelected(false);
+        newGroup->addChild(element);
     }
 
-    elements_.push_back(newGroup);
+    // Хранилище принимает выделение группы вместе с ней
     newGroup->setSelected(true);
+    elements_.push_back(newGroup);
+    indexElement(newGroup);
+    markDirty(damageRect(newGroup));
+    damage = damage.united(damageRect(newGroup));
 
     // Восстанавливаем стрелки
     for (auto& [source, target, bidirectional] : arrowsToRecreate) {
@@ -283,12 +390,11 @@ void ShapeContainer::groupSelected() {
         CompositeElement* newSource = source;
         CompositeElement* newTarget = target;
 
-        // Если source был в группе, заменяем его на группу
-        if (std::find(selected.begin(), selected.end(), source) != selected.end()) {
+        // Концы, попавшие в группу, заменяем на группу
+        if (source->getParent() == newGroup) {
             newSource = newGroup;
         }
-        // Если target был в группе, заменяем его на группу
-        if (std::find(selected.begin(), selected.end(), target) != selected.end()) {
+        if (target->getParent() == newGroup) {
             newTarget = newGroup;
         }
 
@@ -298,31 +404,45 @@ void ShapeContainer::groupSelected() {
 
     qDebug() << "=== groupSelected finished ===";
 
-    notifyObservers("container_changed");
+    invalidateBackground(damage);
+
+    notifyChanged(EventKind::ContainerChanged);
+    // Строки пересоздаваемых стрелок убираются сразу
+    flushRemovals();
 }
 
 void ShapeContainer::ungroupSelected() {
     std::vector<CompositeElement*> selected = getSelectedElements();
     bool changed = false;
+    QRect damage;
 
     for (auto element : selected) {
         if (element && element->isGroup()) {
-            Group* group = dynamic_cast<Group*>(element);
+            Group* group = static_cast<Group*>(element);
             if (group) {
+                QRect groupDamage = damageRectWithArrows({group});
+                markDirty(groupDamage);
+                damage = damage.united(groupDamage);
+
                 // Удаляем все стрелки, связанные с этой группой
                 removeArrowsWithElement(group);
 
                 const std::vector<CompositeElement*>& children = group->getChildren();
 
                 for (auto child : children) {
-                    child->setSelected(element->getSelected());
+                    // Дети остаются выделенными вместо группы
+                    child->setParent(nullptr);
+                    child->setSelected(true);
                     elements_.push_back(child);
+                    indexElement(child);
                 }
 
                 for (int i = (int)elements_.size() - 1; i >= 0; i--) {
                     if (elements_[i] == element) {
+                        unindexElement(element);
                         const_cast<std::vector<CompositeElement*>&>(group->getChildren()).clear();
-                        delete elements_[i];
+                        notifyRemoved(element);
+                        retire(element);
                         elements_.erase(elements_.begin() + i);
                         changed = true;
                         break;
@@ -333,8 +453,10 @@ void ShapeContainer::ungroupSelected() {
     }
 
     if (changed) {
-        notifyObservers("container_changed");
+        invalidateBackground(damage);
+        notifyChanged(EventKind::ContainerChanged);
     }
+    flushRemovals();
 }
 
 void ShapeContainer::moveSelected(int dx, int dy, int maxX, int maxY, int topMargin) {
@@ -346,61 +468,107 @@ void ShapeContainer::moveSelected(int dx, int dy, int maxX, int maxY, int topMar
     qDebug() << "=== moveSelected ===";
     qDebug() << "dx:" << dx << "dy:" << dy;
 
-    // Сначала собираем все выбранные элементы
-    std::vector<CompositeElement*> selected;
-    for (auto element : elements_) {
-        if (element && element->getSelected()) {
-            selected.push_back(element);
-            qDebug() << "Selected element:" << element;
-        }
-    }
+    std::vector<CompositeElement*> selected = store_.selectedElements();
+    std::vector<CompositeElement*> moved = collectMoveSet(selected);
+    QRect oldDamage = damageRectWithArrows(moved);
 
-    // Перемещаем выбранные элементы
-    for (auto element : selected) {
+    // Каждый элемент сдвигается один раз и упирается в край сам по себе
+    for (auto element : moved) {
         element->safeMove(dx, dy, left, top, right, bottom);
     }
 
-    // Теперь обрабатываем стрелки: если переместился source, двигаем target
-    for (auto arrow : arrows_) {
-        CompositeElement* source = arrow->getSource();
-        CompositeElement* target = arrow->getTarget();
+    refreshIndex(moved);
+    QRect damage = oldDamage.united(damageRectWithArrows(moved));
+    markDirty(damage);
 
-        qDebug() << "Arrow source:" << source << "target:" << target;
+    // Фон меняется, только если вместе с выделением сдвинулись невыделенные элементы
+    if (moved.size() > selected.size()) {
+        invalidateBackground(damage);
+    }
 
-        // Если source был перемещен (он в selected), двигаем target
-        if (std::find(selected.begin(), selected.end(), source) != selected.end()) {
-            qDebug() << "Moving target because source moved";
-            if (target) {
-                target->safeMove(dx, dy, left, top, right, bottom);
-            }
-        }
+    notifyChanged(EventKind::ElementsMoved, moved);
+}
 
-        // Если стрелка двунаправленная и переместился target, двигаем source
-        if (arrow->isBidirectional()) {
-            if (std::find(selected.begin(), selected.end(), target) != selected.end()) {
-                qDebug() << "Moving source because target moved (bidirectional)";
-                if (source) {
-                    source->safeMove(dx, dy, left, top, right, bottom);
-                }
-            }
+std::vector<CompositeElement*> ShapeContainer::collectMoveSet(const std::vector<CompositeElement*>& selected) const {
+    // Выделенные элементы и концы их стрелок, которые следуют за ними.
+    // Выделенная цель стрелки уже есть в наборе и второй раз не добавляется
+    std::vector<CompositeElement*> moved = selected;
+    std::unordered_set<const CompositeElement*> seen(selected.begin(), selected.end());
+    for (auto arrow : incidentArrows(selected)) {
+        CompositeElement* follower = nullptr;
+        if (isElementSelected(arrow->getSource())) {
+            follower = arrow->getTarget();
+        } else if (arrow->isBidirectional() && isElementSelected(arrow->getTarget())) {
+            follower = arrow->getSource();
+        }
+        if (follower && seen.insert(follower).second) {
+            moved.push_back(follower);
         }
     }
+    return moved;
+}
+
+QPoint ShapeContainer::dragSelected(int dx, int dy, const QRect& bounds) {
+    std::vector<CompositeElement*> selected = store_.selectedElements();
+    if (selected.empty() || (dx == 0 && dy == 0)) return QPoint(0, 0);
+
+    std::vector<CompositeElement*> moved = collectMoveSet(selected);
+
+    // Общие границы берем из колонок хранилища, без виртуальных вызовов
+    QRect united;
+    for (auto element : moved) {
+        int row = store_.rowOf(element);
+        united = united.united(row >= 0 ? store_.boundsAt(row) : element->getBorderRect());
+    }
+
+    // Одно ограничение на все выделение; уже вышедшие за край элементы
+    // не выталкиваются обратно, но и дальше не сдвигаются
+    int minDx = std::min(0, bounds.left() - united.left());
+    int maxDx = std::max(0, bounds.right() - united.right());
+    int minDy = std::min(0, bounds.top() - united.top());
+    int maxDy = std::max(0, bounds.bottom() - united.bottom());
+    dx = std::max(minDx, std::min(dx, maxDx));
+    dy = std::max(minDy, std::min(dy, maxDy));
+    if (dx == 0 && dy == 0) return QPoint(0, 0);
+
+    QRect oldDamage = damageRectWithArrows(moved);
+    for (auto element : moved) {
+        element->move(dx, dy);
+    }
+    refreshIndex(moved);
+    QRect damage = oldDamage.united(damageRectWithArrows(moved));
+    markDirty(damage);
+
+    // Фон меняется, только если вместе с выделением сдвинулись невыделенные элементы
+    if (moved.size() > selected.size()) {
+        invalidateBackground(damage);
+    }
 
-    notifyObservers("elements_moved");
+    notifyChanged(EventKind::ElementsMoved, moved);
+    return QPoint(dx, dy);
 }
 
 void ShapeContainer::setSelectedColor(const QColor &color) {
-    std::vector<CompositeElement*> allSelected;
-    for (auto element : elements_) {
-        if (element && element->getSelected()) {
-            collectAllElements(element, allSelected);
-        }
-    }
+    std::vector<CompositeElement*> selected = store_.selectedElements();
 
-    for (auto element : allSelected) {
+    // Группа сама перекрашивает своих детей, а ее границы покрывают их
+    for (auto element : selected) {
         element->setColor(color);
+        markDirty(damageRect(element));
+    }
+    notifyChanged(EventKind::ElementsChanged, selected);
+}
+
+bool ShapeContainer::recolorStyle(const QColor& from, const QColor& to) {
+    // Фигуры не перебираются: меняются только записи палитры, на которые они ссылаются
+    if (!palette_.recolor(from.rgba(), to.rgba())) {
+        return false;
     }
-    notifyObservers("elements_changed");
+
+    // Перекрашенные фигуры могут быть где угодно
+    invalidateBackground();
+    notifyChanged(EventKind::ElementsChanged);
+    return true;
 }
 
 void ShapeContainer::collectAllElements(CompositeElement* element, std::vector<CompositeElement*>& result) const {
@@ -427,9 +595,10 @@ void ShapeContainer::collectNonGroupElements(CompositeElement* element, std::vec
 std::string ShapeContainer::saveToString() const
 {
     std::ostringstream oss;
-    oss << elements_.size() << "\n";
+    oss << getLiveCount() << "\n";
 
     for (auto element : elements_) {
+        if (!element) continue;
         std::string elementData = element->save();
         oss << elementData.length() << "\n";
         oss << elementData << "\n";
@@ -445,9 +614,10 @@ bool ShapeContainer::saveToFile(const std::string& filename) const
         return false;
     }
 
-    file << elements_.size() << "\n";
+    file << getLiveCount() << "\n";
 
     for (auto element : elements_) {
+        if (!element) continue;
         std::string elementData = element->save();
         while (!elementData.empty() && elementData.back() == ' ') {
             elementData.pop_back();
@@ -461,12 +631,21 @@ bool ShapeContainer::saveToFile(const std::string& filename) const
 
 void ShapeContainer::loadFromString(const std::string& data)
 {
+    // Очистка и все добавления дают одно уведомление
+    Transaction transaction(*this);
+
     clear();
+    invalidateBackground();
+
+    // Элементы документа размещаются в арене подряд, в порядке файла
+    DocumentArena::Scope arenaScope(&arena_);
+    StylePalette::Scope paletteScope(&palette_);
 
     std::istringstream iss(data);
     int elementCount;
     iss >> elementCount;
     iss.ignore(1, '\n');
+    reserve(elementCount);
 
     for (int i = 0; i < elementCount; ++i) {
         int dataLength;
@@ -479,12 +658,17 @@ void ShapeContainer::loadFromString(const std::string& data)
         CompositeElement* element = ShapeFactory::createFromString(elementData);
         if (element) {
             elements_.push_back(element);
+            indexElement(element);
+            markDirty(damageRect(element));
         }
 
         if (iss.peek() == '\n') {
             iss.ignore(1, '\n');
         }
     }
+
+    // Элементы добавлены без отдельных событий: подписчики перечитают контейнер
+    notifyChanged(EventKind::ContainerChanged);
 }
 
 bool ShapeContainer::loadFromFile(const std::string& filename)
@@ -495,7 +679,10 @@ bool ShapeContainer::loadFromFile(const std::string& filename)
         return false;
     }
 
+    Transaction transaction(*this);
     clear();
+    DocumentArena::Scope arenaScope(&arena_);
+    StylePalette::Scope paletteScope(&palette_);
 
     std::string line;
     int lineNumber = 0;
@@ -505,8 +692,14 @@ bool ShapeContainer::loadFromFile(const std::string& filename)
         return false;
     }
 
-    int elementCount = std::stoi(line);
-    std::cout << "Loading " << elementCount << " elements" << std::endl;
+    // Первая строка - число элементов; файл с другим заголовком документом не считается
+    std::istringstream header(line);
+    int elementCount = 0;
+    if (!(header >> elementCount) || elementCount < 0 || !(header >> std::ws).eof()) {
+        std::cerr << "Invalid header in " << filename << ": " << line << std::endl;
+        return false;
+    }
+    reserve(elementCount);
 
     for (int i = 0; i < elementCount; ++i) {
         if (!std::getline(file, line)) {
@@ -519,19 +712,19 @@ bool ShapeContainer::loadFromFile(const std::string& filename)
             continue;
         }
 
-        std::cout << "Loading element " << i << ": " << line << std::endl;
-
         CompositeElement* element = ShapeFactory::createFromString(line);
         if (element) {
             elements_.push_back(element);
-            std::cout << "Successfully created element of type " << element->getTypeName() << std::endl;
+            indexElement(element);
+            markDirty(damageRect(element));
         } else {
             std::cerr << "Failed to create element from line: " << line << std::endl;
         }
     }
 
     file.close();
-    std::cout << "Loaded " << elements_.size() << " elements" << std::endl;
+    invalidateBackground();
+    notifyChanged(EventKind::ContainerChanged);
     return true;
 }
 
@@ -540,27 +733,33 @@ void ShapeContainer::addArrow(CompositeElement* source, CompositeElement* target
     if (!source || !target || source == target) return;
 
     Arrow* arrow = new Arrow(source, target, bidirectional);
-    arrows_.push_back(arrow);
-    notifyObservers("element_added", arrow);
+    linkArrow(arrow);
+    QRect damage = damageRect(arrow);
+    markDirty(damage);
+    invalidateBackground(damage);
+    notifyChanged(EventKind::ElementAdded, arrow);
 }
 
 void ShapeContainer::removeArrow(Arrow* arrow) {
-    auto it = std::find(arrows_.begin(), arrows_.end(), arrow);
-    if (it != arrows_.end()) {
-        delete *it;
-        arrows_.erase(it);
-        notifyObservers("element_removed");
+    if (arrowSlots_.count(arrow)) {
+        QRect damage = damageRect(arrow);
+        markDirty(damage);
+        unlinkArrow(arrow);
+        invalidateBackground(damage);
+        flushRemovals();
     }
 }
 
 void ShapeContainer::removeSelectedArrows() {
-    for (int i = arrows_.size() - 1; i >= 0; i--) {
-        if (arrows_[i]->getSelected()) {
-            delete arrows_[i];
-            arrows_.erase(arrows_.begin() + i);
-        }
+    std::vector<Arrow*> selected = selectedArrows_;
+    QRect damage;
+    for (auto arrow : selected) {
+        damage = damage.united(damageRect(arrow));
+        unlinkArrow(arrow);
     }
-    notifyObservers("element_removed");
+    markDirty(damage);
+    invalidateBackground(damage);
+    flushRemovals();
 }
 
 void ShapeContainer::drawArrows(QPainter& painter) const {
@@ -569,35 +768,294 @@ void ShapeContainer::drawArrows(QPainter& painter) const {
     }
 }
 
+// Верхний из кандидатов (они идут сверху вниз), точно задетый точкой
+static CompositeElement* topmostHit(const std::vector<CompositeElement*>& candidates, int x, int y) {
+    if (candidates.empty()) return nullptr;
+
+    // Листья проверяются пакетом; в пакет добавляем снизу вверх, последний
+    // добавленный считается верхним. Группы в пакет не раскладываются:
+    // их проверяет собственная иерархия границ (Group::contains -> childAt)
+    HitTestBatch batch;
+    std::vector<int> groups;
+    for (int i = (int)candidates.size() - 1; i >= 0; --i) {
+        if (candidates[i]->isGroup()) {
+            groups.push_back(i);
+        } else {
+            candidates[i]->addToHitTest(batch, i);
+        }
+    }
+
+    int hit = batch.topmost(x, y);
+
+    // Группы выше найденного листа проверяем сверху вниз
+    for (auto it = groups.rbegin(); it != groups.rend(); ++it) {
+        if (hit >= 0 && *it > hit) break;
+        if (candidates[*it]->contains(x, y)) {
+            return candidates[*it];
+        }
+    }
+    return hit >= 0 ? candidates[hit] : nullptr;
+}
+
 CompositeElement* ShapeContainer::findElementAt(int x, int y, bool includeArrows) {
     // Сначала проверяем стрелки (они обычно тоньше)
     if (includeArrows) {
-        for (int i = arrows_.size() - 1; i >= 0; i--) {
-            if (arrows_[i]->contains(x, y)) {
-                return arrows_[i];
-            }
+        if (CompositeElement* arrow = topmostHit(arrowIndex_.queryPoint(x, y), x, y)) {
+            return arrow;
         }
     }
 
     // Потом проверяем обычные элементы
-    for (int i = elements_.size() - 1; i >= 0; i--) {
-        if (elements_[i]->contains(x, y)) {
-            return elements_[i];
+    return topmostHit(elementIndex_.queryPoint(x, y), x, y);
+}
+
+std::vector<CompositeElement*> ShapeContainer::findElementsInRect(const QRect& rect) const {
+    return elementIndex_.queryRect(rect);
+}
+
+std::vector<CompositeElement*> ShapeContainer::elementsInRect(const QRect& rect, bool inside) const {
+    // Сетка хранит границы с запасом, поэтому кандидатов проверяем по точным
+    // границам из хранилища
+    std::vector<CompositeElement*> result;
+    for (auto element : elementIndex_.queryRect(rect)) {
+        int row = store_.rowOf(element);
+        if (row >= 0 && store_.inRect(row, rect, inside)) {
+            result.push_back(element);
         }
     }
+    return result;
+}
 
-    return nullptr;
+std::vector<Arrow*> ShapeContainer::findArrowsInRect(const QRect& rect) const {
+    std::vector<Arrow*> result;
+    for (auto candidate : arrowIndex_.queryRect(rect)) {
+        result.push_back(static_cast<Arrow*>(candidate));
+    }
+    return result;
+}
+
+QRect ShapeContainer::contentRect() const {
+    QRect bounds;
+    for (auto element : elements_) {
+        bounds = bounds.united(damageRect(element));
+    }
+    for (auto arrow : arrows_) {
+        bounds = bounds.united(arrow->getSafeBorderRect(REPAINT_MARGIN));
+    }
+    return bounds;
+}
+
+void ShapeContainer::elementGeometryChanged(CompositeElement* element) {
+    if (!element) return;
+
+    // Старые границы берем из индекса, новые - у самого элемента
+    QRect oldDamage = elementIndex_.boundsOf(element);
+    for (auto arrow : incidentArrows({element})) {
+        oldDamage = oldDamage.united(arrowIndex_.boundsOf(arrow));
+    }
+    markDirty(oldDamage);
+
+    // Размер меняется в обход методов элемента, поэтому сообщаем стрелкам сами
+    element->notifyGeometryChanged();
+    refreshIndex({element});
+    QRect newDamage = damageRectWithArrows({element});
+    markDirty(newDamage);
+
+    if (!isInSelectionLayer(element)) {
+        invalidateBackground(oldDamage.united(newDamage));
+    }
+}
+
+bool ShapeContainer::isInSelectionLayer(const CompositeElement* element) const {
+    return element && element->getSelected();
+}
+
+bool ShapeContainer::isInSelectionLayer(const Arrow* arrow) const {
+    // Стрелка рисуется поверх, если она выделена или ведет к выделенному элементу
+    return arrow->getSelected() ||
+           isInSelectionLayer(arrow->getSource()) ||
+           isInSelectionLayer(arrow->getTarget());
+}
+
+void ShapeContainer::getSelectionLayer(std::vector<CompositeElement*>& elements, std::vector<Arrow*>& arrows) const {
+    elements = getSelectedElements();
+
+    // Стрелки выделенных элементов и выделенные стрелки, без повторов
+    arrows = incidentArrows(elements);
+    for (auto arrow : selectedArrows_) {
+        if (!isInSelectionLayer(arrow->getSource()) && !isInSelectionLayer(arrow->getTarget())) {
+            arrows.push_back(arrow);
+        }
+    }
+}
+
+void ShapeContainer::destroyArrow(Arrow* arrow) {
+    arrowIndex_.remove(arrow);
+    auto it = std::find(selectedArrows_.begin(), selectedArrows_.end(), arrow);
+    if (it != selectedArrows_.end()) {
+        *it = selectedArrows_.back();
+        selectedArrows_.pop_back();
+    }
+    retire(arrow);
 }
 
 void ShapeContainer::removeArrowsWithElement(CompositeElement* element) {
     qDebug() << "removeArrowsWithElement for" << element;
 
-    for (int i = arrows_.size() - 1; i >= 0; i--) {
-        Arrow* arrow = arrows_[i];
-        if (arrow->getSource() == element || arrow->getTarget() == element) {
-            qDebug() << "  Removing arrow" << arrow;
-            delete arrow;
-            arrows_.erase(arrows_.begin() + i);
+    for (auto arrow : incidentArrows({element})) {
+        qDebug() << "  Removing arrow" << arrow;
+        unlinkArrow(arrow);
+    }
+}
+
+void ShapeContainer::linkArrow(Arrow* arrow) {
+    arrowSlots_[arrow] = (int)arrows_.size();
+    arrows_.push_back(arrow);
+    incidence_[arrow->getSource()].outgoing.push_back(arrow);
+    incidence_[arrow->getTarget()].incoming.push_back(arrow);
+    indexArrow(arrow);
+}
+
+// Убирает стрелку из списка, переставляя на ее место последнюю
+static void swapRemove(std::vector<Arrow*>& arrows, Arrow* arrow) {
+    auto it = std::find(arrows.begin(), arrows.end(), arrow);
+    if (it != arrows.end()) {
+        *it = arrows.back();
+        arrows.pop_back();
+    }
+}
+
+void ShapeContainer::unlinkArrow(Arrow* arrow) {
+    auto slot = arrowSlots_.find(arrow);
+    if (slot == arrowSlots_.end()) return;
+
+    // Последняя стрелка занимает место удаленной
+    int i = slot->second;
+    arrowSlots_.erase(slot);
+    Arrow* last = arrows_.back();
+    arrows_.pop_back();
+    if (last != arrow) {
+        arrows_[i] = last;
+        arrowSlots_[last] = i;
+    }
+
+    for (CompositeElement* end : { arrow->getSource(), arrow->getTarget() }) {
+        auto it = incidence_.find(end);
+        if (it == incidence_.end()) continue;
+        swapRemove(end == arrow->getSource() ? it->second.outgoing : it->second.incoming, arrow);
+        if (it->second.outgoing.empty() && it->second.incoming.empty()) {
+            incidence_.erase(it);
+        }
+    }
+
+    notifyRemoved(arrow);
+    destroyArrow(arrow);
+}
+
+std::vector<Arrow*> ShapeContainer::incidentArrows(const std::vector<CompositeElement*>& elements) const {
+    std::unordered_set<const CompositeElement*> ends(elements.begin(), elements.end());
+
+    std::vector<Arrow*> result;
+    for (const CompositeElement* element : ends) {
+        auto it = incidence_.find(element);
+        if (it == incidence_.end()) continue;
+
+        result.insert(result.end(), it->second.outgoing.begin(), it->second.outgoing.end());
+        for (auto arrow : it->second.incoming) {
+            // Стрелка между двумя элементами набора уже учтена у источника
+            if (!ends.count(arrow->getSource())) {
+                result.push_back(arrow);
+            }
         }
     }
+    return result;
+}
+
+void ShapeContainer::markDirty(const QRect& rect) {
+    if (rect.isEmpty()) return;
+    dirtyRect_ = dirtyRect_.united(rect);
+    pending_.dirty = pending_.dirty.united(rect);
+}
+
+void ShapeContainer::invalidateElement(CompositeElement* element) {
+    if (element) {
+        store_.refresh(element);
+        QRect damage = damageRectWithArrows({element});
+        markDirty(damage);
+        // Элемент мог перейти между фоном и слоем выделения
+        invalidateBackground(damage);
+    }
+}
+
+QRect ShapeContainer::takeDirtyRect() {
+    QRect rect = dirtyRect_;
+    dirtyRect_ = QRect();
+    return rect;
+}
+
+void ShapeContainer::invalidateBackground() {
+    backgroundFull_ = true;
+    backgroundDirty_ = QRect();
+    ++backgroundRevision_;
+}
+
+void ShapeContainer::invalidateBackground(const QRect& rect) {
+    if (rect.isEmpty()) return;
+    if (!backgroundFull_) {
+        backgroundDirty_ = backgroundDirty_.united(rect);
+    }
+    ++backgroundRevision_;
+}
+
+QRect ShapeContainer::takeBackgroundDirty(bool& full) {
+    full = backgroundFull_;
+    QRect rect = backgroundDirty_;
+    backgroundFull_ = false;
+    backgroundDirty_ = QRect();
+    return rect;
+}
+
+QRect ShapeContainer::damageRect(const CompositeElement* element) const {
+    if (!element) return QRect();
+    return element->getSafeBorderRect(REPAINT_MARGIN);
+}
+
+QRect ShapeContainer::damageRectWithArrows(const std::vector<CompositeElement*>& elements) const {
+    QRect damage;
+    for (auto element : elements) {
+        damage = damage.united(damageRect(element));
+    }
+
+    // Стрелки, связанные с элементами, тоже меняют свое положение
+    for (auto arrow : incidentArrows(elements)) {
+        damage = damage.united(damageRect(arrow));
+    }
+    return damage;
+}
+
+void ShapeContainer::indexElement(CompositeElement* element) {
+    quint64 order = nextOrder_++;
+    elementIndex_.insert(element, damageRect(element), order);
+    store_.insert(element, order);
+}
+
+void ShapeContainer::unindexElement(CompositeElement* element) {
+    elementIndex_.remove(element);
+    store_.remove(element);
+}
+
+void ShapeContainer::indexArrow(Arrow* arrow) {
+    arrowIndex_.insert(arrow, damageRect(arrow), nextOrder_++);
+}
+
+void ShapeContainer::refreshIndex(const std::vector<CompositeElement*>& elements) {
+    for (auto element : elements) {
+        elementIndex_.update(element, damageRect(element));
+        store_.refresh(element);
+    }
+
+    // Границы стрелок зависят от положения их концов
+    for (auto arrow : incidentArrows(elements)) {
+        arrowIndex_.update(arrow, damageRect(arrow));
+    }
 }
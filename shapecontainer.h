@@ -2,8 +2,13 @@
 #define SHAPECONTAINER_H
 
 #include <vector>
+#include <unordered_map>
 #include "composite.h"
 #include "observer.h"
+#include "spatialindex.h"
+#include "shapestore.h"
+#include "documentarena.h"
+#include "stylepalette.h"
 
 // Предварительное объявление класса Arrow
 class Arrow;
@@ -14,14 +19,97 @@ private:
     std::vector<CompositeElement*> elements_;
     std::vector<Arrow*> arrows_;
     CompositeElement* arrowSource_;
+    QRect dirtyRect_;  // Область, которую нужно перерисовать после изменений
+
+    // Пространственные индексы элементов и стрелок; порядок вставки задает z-порядок
+    SpatialIndex elementIndex_;
+    SpatialIndex arrowIndex_;
+    quint64 nextOrder_;
+
+    // Колоночная копия границ, цветов и флагов элементов верхнего уровня;
+    // в ней же хранится выделение элементов
+    ShapeStore store_;
+    std::vector<Arrow*> selectedArrows_;
+
+    // Стрелки каждого элемента и позиции стрелок в arrows_, чтобы удалять
+    // и искать стрелки за O(числа связанных), а не перебором всех стрелок
+    struct Incidence {
+        std::vector<Arrow*> outgoing;
+        std::vector<Arrow*> incoming;
+    };
+    std::unordered_map<const CompositeElement*, Incidence> incidence_;
+    std::unordered_map<const Arrow*, int> arrowSlots_;
+
+    // Память элементов и стрелок, загруженных из файла или строки.
+    // Освобождается целиком в clear() после удаления всех объектов.
+    DocumentArena arena_;
+
+    // Перья и кисти фигур документа. Освобождается в clear() вместе с ареной
+    StylePalette palette_;
+
+    // Номер версии невыделенного содержимого (фонового слоя)
+    quint64 backgroundRevision_;
+    // Устаревшая с последней отрисовки фона область (мировые координаты)
+    // и признак того, что фон нужно перерисовать целиком
+    QRect backgroundDirty_;
+    bool backgroundFull_;
+
+    // Состояние пакетного изменения
+    int transactionDepth_;
+    int removedSlots_;      // Пустые слоты в elements_ от удалений внутри транзакции
+
+    // Изменения, еще не разосланные подписчикам
+    ChangeSet pending_;
+
+    // Удаления рассылаются сразу, не дожидаясь кадра: подписчики (строки
+    // дерева) держат указатели на объекты. Сами объекты освобождаются только
+    // после рассылки; внутри транзакции - при ее завершении.
+    ChangeSet removals_;
+    std::vector<CompositeElement*> retired_;
 
     void removeArrowsWithElement(CompositeElement* element);  // Добавить эту строку
 
 public:
+    // Запас вокруг границ элемента: толщина пера, рамка и маркеры выделения
+    static const int REPAINT_MARGIN = 6;
+
     ShapeContainer();
     ~ShapeContainer();
 
+    // Пакетное изменение. Удаленные внутри транзакции элементы оставляют пустой
+    // слот (getElement вернет nullptr, индексы не сдвигаются), все слоты
+    // убираются одним проходом при завершении. Пока транзакция открыта,
+    // flushChanges ничего не рассылает; завершение внешней транзакции сразу
+    // рассылает накопленное одним уведомлением. Транзакции могут быть вложенными.
+    void beginTransaction();
+    void commitTransaction();
+    bool inTransaction() const { return transactionDepth_ > 0; }
+    // Заранее выделяет память под добавляемые элементы и стрелки
+    void reserve(int elements, int arrows = 0);
+
+    // Изменения копятся в один ChangeSet и рассылаются подписчикам этим
+    // вызовом, обычно раз в кадр
+    void flushChanges();
+    const ChangeSet& pendingChanges() const { return pending_; }
+
+    class Transaction
+    {
+    public:
+        explicit Transaction(ShapeContainer& container) : container_(container) { container_.beginTransaction(); }
+        ~Transaction() { container_.commitTransaction(); }
+
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+    private:
+        ShapeContainer& container_;
+    };
+
     void addElement(CompositeElement* element);
+    // Вне транзакции слот сразу удаляется из elements_ со сдвигом хвоста
+    // (O(n)), чтобы индексы getElement оставались плотными. Удалять много
+    // элементов по одному нужно внутри Transaction: там слоты только
+    // помечаются и убираются одним проходом при ее завершении.
     void removeElement(int i);
     void clear();
 
@@ -30,8 +118,18 @@ public:
     void selectAll();
     void notifySelectionChanged();
 
+    // Выделение принадлежит контейнеру, флаг в элементе - копия для отрисовки.
+    // Выделение элемента или группы любого размера стоит O(1).
+    void setElementSelected(CompositeElement* element, bool selected);
+    bool isElementSelected(const CompositeElement* element) const;
+    // Есть ли элемент или стрелка на верхнем уровне документа. Проверяется
+    // только адрес, поэтому можно передавать удаленные элементы из ChangeSet.
+    bool contains(const CompositeElement* element) const;
+
     CompositeElement* getElement(int i) const;
     int getCount() const;
+    // Число элементов без пустых слотов открытой транзакции
+    int getLiveCount() const { return (int)elements_.size() - removedSlots_; }
 
     std::vector<CompositeElement*> getSelectedElements() const;
     bool hasSelectedElements() const;
@@ -41,7 +139,14 @@ public:
     void ungroupSelected();
 
     void moveSelected(int dx, int dy, int maxX, int maxY, int topMargin);
+    // Быстрое перемещение выделения при перетаскивании. Смещение ограничивается
+    // один раз по общим границам всех сдвигаемых элементов (bounds - допустимая
+    // область), затем элементы сдвигаются без поэлементных проверок safeMove.
+    // Возвращает примененное смещение.
+    QPoint dragSelected(int dx, int dy, const QRect& bounds);
     void setSelectedColor(const QColor &color);
+    // Перекрашивает все фигуры цвета from одним изменением палитры документа
+    bool recolorStyle(const QColor& from, const QColor& to);
 
     std::string saveToString() const;
     bool saveToFile(const std::string& filename) const;
@@ -54,6 +159,8 @@ public:
     void removeArrow(Arrow* arrow);
     void removeSelectedArrows();
     std::vector<Arrow*> getArrows() const { return arrows_; }
+    int getArrowCount() const { return (int)arrows_.size(); }
+    Arrow* getArrow(int i) const { return arrows_[i]; }
     void drawArrows(QPainter& painter) const;
 
     void setArrowSource(CompositeElement* source) { arrowSource_ = source; }
@@ -62,9 +169,72 @@ public:
 
     CompositeElement* findElementAt(int x, int y, bool includeArrows = true);
 
+    // Элементы и стрелки, пересекающие прямоугольник, в порядке отрисовки
+    std::vector<CompositeElement*> findElementsInRect(const QRect& rect) const;
+    std::vector<Arrow*> findArrowsInRect(const QRect& rect) const;
+    // Элементы верхнего уровня, целиком лежащие в прямоугольнике (inside) или
+    // задетые им, в порядке отрисовки. Кандидаты берутся из сетки, поэтому
+    // стоимость зависит от площади прямоугольника, а не от размера документа.
+    std::vector<CompositeElement*> elementsInRect(const QRect& rect, bool inside) const;
+
+    // Границы всего содержимого документа вместе с рамками и стрелками
+    QRect contentRect() const;
+
+    // Вызывается после изменения геометрии элемента вне контейнера (например, размера)
+    void elementGeometryChanged(CompositeElement* element);
+
+    // Отслеживание поврежденных областей для частичной перерисовки
+    void markDirty(const QRect& rect);
+    void invalidateElement(CompositeElement* element);
+    QRect takeDirtyRect();
+
+    // Разделение на кэшируемый фон и живой слой выделения
+    bool isInSelectionLayer(const CompositeElement* element) const;
+    bool isInSelectionLayer(const Arrow* arrow) const;
+    void getSelectionLayer(std::vector<CompositeElement*>& elements, std::vector<Arrow*>& arrows) const;
+    quint64 backgroundRevision() const { return backgroundRevision_; }
+    // Фон целиком устарел (загрузка, очистка, массовая смена выделения)
+    void invalidateBackground();
+    // Устарела только область rect фона; области копятся до takeBackgroundDirty
+    void invalidateBackground(const QRect& rect);
+    // Забирает накопленную область фона; full == true — перерисовать весь фон
+    QRect takeBackgroundDirty(bool& full);
+
 private:
     void collectAllElements(CompositeElement* element, std::vector<CompositeElement*>& result) const;
     void collectNonGroupElements(CompositeElement* element, std::vector<CompositeElement*>& result) const;
+    QRect damageRect(const CompositeElement* element) const;
+    QRect damageRectWithArrows(const std::vector<CompositeElement*>& elements) const;
+
+    void indexElement(CompositeElement* element);
+    void unindexElement(CompositeElement* element);
+    void indexArrow(Arrow* arrow);
+    // Добавляет стрелку в arrows_, связи концов и индекс
+    void linkArrow(Arrow* arrow);
+    // Убирает стрелку из arrows_, связей концов, индекса и выделения и
+    // отдает ее на освобождение после рассылки удаления
+    void unlinkArrow(Arrow* arrow);
+    void destroyArrow(Arrow* arrow);
+
+    // Добавляет событие в накопленный набор изменений
+    void notifyChanged(EventKind kind, CompositeElement* element = nullptr);
+    void notifyChanged(EventKind kind, const std::vector<CompositeElement*>& elements);
+    // Удаление: объект уже убран из контейнера, но освобождается только
+    // после того, как подписчики узнают о нем (flushRemovals)
+    void notifyRemoved(CompositeElement* element);
+    void notifyRemoved(const std::vector<CompositeElement*>& elements);
+    void retire(CompositeElement* element);
+    // Рассылает накопленные удаления и освобождает удаленные объекты;
+    // внутри транзакции ничего не делает
+    void flushRemovals();
+    void releaseRetired();
+    void compactElements();
+    // Стрелки, связанные с элементами, каждая один раз
+    std::vector<Arrow*> incidentArrows(const std::vector<CompositeElement*>& elements) const;
+    // Что сдвигается вместе с выделением: выделенные и концы их стрелок, каждый один раз.
+    // Общий набор для moveSelected и dragSelected
+    std::vector<CompositeElement*> collectMoveSet(const std::vector<CompositeElement*>& selected) const;
+    void refreshIndex(const std::vector<CompositeElement*>& elements);
 };
 
 #endif // SHAPECONTAINER_H
@@ -12,59 +12,44 @@
 
 CompositeElement* ShapeFactory::createElement(const std::string& type, const std::string& data)
 {
-    if (type == "Circle") {
-        return createCircle(data);
+    ShapeKind kind;
+    if (!shapeKindFromName(type, kind)) {
+        return nullptr;
     }
-    else if (type == "Rectangle") {
-        return createRectangle(data);
-    }
-    else if (type == "Square") {
-        return createSquare(data);
-    }
-    else if (type == "Triangle") {
-        return createTriangle(data);
-    }
-    else if (type == "Line") {
-        return createLine(data);
-    }
-    else if (type == "Group") {
-        return createGroup(data);
-    }
-
-    return nullptr;
+    return createByKind(kind, data);
 }
 
 CompositeElement* ShapeFactory::createFromString(const std::string& data)
 {
-    std::cout << "Creating from string: " << data << std::endl;
-
     std::istringstream iss(data);
     std::string type;
     iss >> type;
 
-    if (type == "Circle") {
-        return createCircle(data);
-    }
-    else if (type == "Rectangle") {
-        return createRectangle(data);
-    }
-    else if (type == "Square") {
-        return createSquare(data);
-    }
-    else if (type == "Triangle") {
-        return createTriangle(data);
-    }
-    else if (type == "Line") {
-        return createLine(data);
-    }
-    else if (type == "Group") {
-        return createGroup(data);
+    ShapeKind kind;
+    if (shapeKindFromName(type, kind)) {
+        if (CompositeElement* element = createByKind(kind, data)) {
+            return element;
+        }
     }
 
     std::cerr << "Unknown type: " << type << std::endl;
     return nullptr;
 }
 
+CompositeElement* ShapeFactory::createByKind(ShapeKind kind, const std::string& data)
+{
+    switch (kind) {
+    case ShapeKind::Circle:    return createCircle(data);
+    case ShapeKind::Rectangle: return createRectangle(data);
+    case ShapeKind::Square:    return createSquare(data);
+    case ShapeKind::Triangle:  return createTriangle(data);
+    case ShapeKind::Line:      return createLine(data);
+    case ShapeKind::Group:     return createGroup(data);
+    case ShapeKind::Arrow:     break;  // Стрелки не создаются из строки
+    }
+    return nullptr;
+}
+
 CompositeElement* ShapeFactory::createCircle(const std::string& data)
 {
     std::istringstream iss(data);
@@ -75,14 +60,11 @@ CompositeElement* ShapeFactory::createCircle(const std::string& data)
 
     iss >> type >> x >> y >> r >> g >> b >> a >> selected >> radius;
 
-    std::cout << "Creating Circle: x=" << x << " y=" << y << " radius=" << radius
-              << " selected=" << selected << std::endl;
-
-    Circle* circle = new Circle(x, y, radius);
+    ShapeAdapter* circle = new ShapeAdapter(Circle(x, y, radius));
     circle->setColor(QColor(r, g, b, a));
     circle->setSelected(selected);
 
-    return new ShapeAdapter(circle);
+    return circle;
 }
 
 CompositeElement* ShapeFactory::createRectangle(const std::string& data)
@@ -95,15 +77,11 @@ CompositeElement* ShapeFactory::createRectangle(const std::string& data)
 
     iss >> type >> x >> y >> r >> g >> b >> a >> selected >> width >> height;
 
-    std::cout << "Creating Rectangle: x=" << x << " y=" << y
-              << " width=" << width << " height=" << height
-              << " selected=" << selected << std::endl;
-
-    Rectangle* rect = new Rectangle(x, y, width, height);
+    ShapeAdapter* rect = new ShapeAdapter(Rectangle(x, y, width, height));
     rect->setColor(QColor(r, g, b, a));
     rect->setSelected(selected);
 
-    return new ShapeAdapter(rect);
+    return rect;
 }
 
 CompositeElement* ShapeFactory::createSquare(const std::string& data)
@@ -116,14 +94,11 @@ CompositeElement* ShapeFactory::createSquare(const std::string& data)
 
     iss >> type >> x >> y >> r >> g >> b >> a >> selected >> size;
 
-    std::cout << "Creating Square: x=" << x << " y=" << y
-              << " size=" << size << " selected=" << selected << std::endl;
-
-    Square* square = new Square(x, y, size);
+    ShapeAdapter* square = new ShapeAdapter(Square(x, y, size));
     square->setColor(QColor(r, g, b, a));
     square->setSelected(selected);
 
-    return new ShapeAdapter(square);
+    return square;
 }
 
 CompositeElement* ShapeFactory::createTriangle(const std::string& data)
@@ -136,14 +111,11 @@ CompositeElement* ShapeFactory::createTriangle(const std::string& data)
 
     iss >> type >> x >> y >> r >> g >> b >> a >> selected >> size;
 
-    std::cout << "Creating Triangle: x=" << x << " y=" << y
-              << " size=" << size << " selected=" << selected << std::endl;
-
-    Triangle* triangle = new Triangle(x, y, size);
+    ShapeAdapter* triangle = new ShapeAdapter(Triangle(x, y, size));
     triangle->setColor(QColor(r, g, b, a));
     triangle->setSelected(selected);
 
-    return new ShapeAdapter(triangle);
+    return triangle;
 }
 
 CompositeElement* ShapeFactory::createLine(const std::string& data)
@@ -156,21 +128,15 @@ CompositeElement* ShapeFactory::createLine(const std::string& data)
 
     iss >> type >> x >> y >> r >> g >> b >> a >> selected >> x2 >> y2 >> thickness;
 
-    std::cout << "Creating Line: x1=" << x << " y1=" << y
-              << " x2=" << x2 << " y2=" << y2
-              << " thickness=" << thickness << " selected=" << selected << std::endl;
-
-    Line* line = new Line(x, y, x2, y2, thickness);
+    ShapeAdapter* line = new ShapeAdapter(Line(x, y, x2, y2, thickness));
     line->setColor(QColor(r, g, b, a));
     line->setSelected(selected);
 
-    return new ShapeAdapter(line);
+    return line;
 }
 
 CompositeElement* ShapeFactory::createGroup(const std::string& data)
 {
-    std::cout << "Creating group from data: " << data << std::endl;
-
     std::istringstream iss(data);
     std::string type;
     int selected;
@@ -180,10 +146,6 @@ CompositeElement* ShapeFactory::createGroup(const std::string& data)
     // Читаем заголовок группы
     iss >> type >> selected >> r >> g >> b >> a >> childCount;
 
-    std::cout << "Group header: selected=" << selected
-              << " color=" << r << "," << g << "," << b << "," << a
-              << " childCount=" << childCount << std::endl;
-
     Group* group = new Group();
     group->setSelected(selected != 0);
     group->setColor(QColor(r, g, b, a));
@@ -210,19 +172,15 @@ CompositeElement* ShapeFactory::createGroup(const std::string& data)
             }
         }
 
-        std::cout << "Child " << i << " data: " << childData << std::endl;
-
         if (!childData.empty()) {
             CompositeElement* child = createFromString(childData);
             if (child) {
                 group->addChild(child);
-                std::cout << "Successfully added child of type " << child->getTypeName() << std::endl;
             } else {
                 std::cerr << "Failed to create child from data: " << childData << std::endl;
             }
         }
     }
 
-    std::cout << "Group created with " << group->getChildren().size() << " children" << std::endl;
     return group;
 }
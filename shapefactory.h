@@ -17,6 +17,9 @@ public:
     static CompositeElement* createFromString(const std::string& data);
 
 private:
+    // Выбор метода создания по тегу типа
+    static CompositeElement* createByKind(ShapeKind kind, const std::string& data);
+
     // Вспомогательные методы для создания конкретных фигур
     static CompositeElement* createCircle(const std::string& data);
     static CompositeElement* createRectangle(const std::string& data);
@@ -0,0 +1,50 @@
+#ifndef SHAPEKIND_H
+#define SHAPEKIND_H
+
+#include <string>
+
+// Тег конкретного типа элемента. Хранится в каждом элементе, поэтому
+// сохранение, изменение размера, дерево объектов и фабрика выбирают ветку
+// через switch по тегу, а не цепочкой dynamic_cast.
+// Порядок листовых типов совпадает с порядком типов в LeafShape.
+enum class ShapeKind : unsigned char
+{
+    Circle,
+    Rectangle,
+    Square,
+    Triangle,
+    Line,
+    Group,
+    Arrow
+};
+
+const int SHAPE_KIND_COUNT = 7;
+
+// Имена типов в формате файла, по индексу тега
+constexpr const char* SHAPE_KIND_NAMES[SHAPE_KIND_COUNT] = {
+    "Circle", "Rectangle", "Square", "Triangle", "Line", "Group", "Arrow"
+};
+
+constexpr const char* shapeKindName(ShapeKind kind)
+{
+    return SHAPE_KIND_NAMES[static_cast<int>(kind)];
+}
+
+constexpr bool isLeafKind(ShapeKind kind)
+{
+    return kind <= ShapeKind::Line;
+}
+
+// Тег по имени типа из файла; false, если имя неизвестно
+inline bool shapeKindFromName(const std::string& name, ShapeKind& kind)
+{
+    for (int i = 0; i < SHAPE_KIND_COUNT; ++i) {
+        if (name == SHAPE_KIND_NAMES[i]) {
+            kind = static_cast<ShapeKind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // SHAPEKIND_H
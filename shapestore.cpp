@@ -0,0 +1,211 @@
+#include "shapestore.h"
+#include "composite.h"
+#include <algorithm>
+
+void ShapeStore::insert(CompositeElement* element, quint64 order)
+{
+    if (!element) return;
+
+    if (rows_.count(element)) {
+        remove(element);
+    }
+
+    int row = (int)elements_.size();
+    elements_.push_back(element);
+    left_.push_back(0);
+    top_.push_back(0);
+    right_.push_back(0);
+    bottom_.push_back(0);
+    flags_.push_back(0);
+    order_.push_back(order);
+    slots_.push_back(-1);
+    rows_[element] = row;
+
+    write(row, element);
+
+    // Новый элемент приходит в хранилище со своим выделением
+    if (element->getSelected()) {
+        select(row);
+    }
+}
+
+void ShapeStore::remove(CompositeElement* element)
+{
+    auto it = rows_.find(element);
+    if (it == rows_.end()) return;
+
+    int row = it->second;
+    int last = (int)elements_.size() - 1;
+    if (slots_[row] >= 0) {
+        deselect(row);
+    }
+    rows_.erase(it);
+
+    // Переносим последнюю строку на место удаленной
+    if (row != last) {
+        elements_[row] = elements_[last];
+        left_[row] = left_[last];
+        top_[row] = top_[last];
+        right_[row] = right_[last];
+        bottom_[row] = bottom_[last];
+        flags_[row] = flags_[last];
+        order_[row] = order_[last];
+        slots_[row] = slots_[last];
+        rows_[elements_[row]] = row;
+    }
+
+    elements_.pop_back();
+    left_.pop_back();
+    top_.pop_back();
+    right_.pop_back();
+    bottom_.pop_back();
+    flags_.pop_back();
+    order_.pop_back();
+    slots_.pop_back();
+}
+
+void ShapeStore::clear()
+{
+    elements_.clear();
+    left_.clear();
+    top_.clear();
+    right_.clear();
+    bottom_.clear();
+    flags_.clear();
+    order_.clear();
+    slots_.clear();
+    rows_.clear();
+    selection_.clear();
+}
+
+void ShapeStore::reserve(int rows)
+{
+    elements_.reserve(rows);
+    left_.reserve(rows);
+    top_.reserve(rows);
+    right_.reserve(rows);
+    bottom_.reserve(rows);
+    flags_.reserve(rows);
+    order_.reserve(rows);
+    slots_.reserve(rows);
+    rows_.reserve(rows);
+}
+
+void ShapeStore::refresh(CompositeElement* element)
+{
+    int row = rowOf(element);
+    if (row >= 0) {
+        write(row, element);
+    }
+}
+
+bool ShapeStore::setSelected(CompositeElement* element, bool selected)
+{
+    int row = rowOf(element);
+    if (row < 0 || (slots_[row] >= 0) == selected) {
+        return false;
+    }
+
+    if (selected) {
+        select(row);
+    } else {
+        deselect(row);
+    }
+    return true;
+}
+
+void ShapeStore::selectAll()
+{
+    for (int row = 0; row < size(); ++row) {
+        if (slots_[row] < 0) {
+            select(row);
+        }
+    }
+}
+
+void ShapeStore::clearSelection()
+{
+    for (CompositeElement* element : selection_) {
+        int row = rows_.at(element);
+        flags_[row] &= ~SelectedFlag;
+        slots_[row] = -1;
+    }
+    selection_.clear();
+}
+
+void ShapeStore::select(int row)
+{
+    slots_[row] = (int)selection_.size();
+    selection_.push_back(elements_[row]);
+    flags_[row] |= SelectedFlag;
+}
+
+void ShapeStore::deselect(int row)
+{
+    // Последний выделенный занимает место удаленного
+    int slot = slots_[row];
+    CompositeElement* moved = selection_.back();
+    selection_[slot] = moved;
+    slots_[rows_.at(moved)] = slot;
+    selection_.pop_back();
+
+    slots_[row] = -1;
+    flags_[row] &= ~SelectedFlag;
+}
+
+int ShapeStore::rowOf(const CompositeElement* element) const
+{
+    auto it = rows_.find(element);
+    return it == rows_.end() ? -1 : it->second;
+}
+
+QRect ShapeStore::boundsAt(int row) const
+{
+    return QRect(QPoint(left_[row], top_[row]), QPoint(right_[row], bottom_[row]));
+}
+
+std::vector<CompositeElement*> ShapeStore::selectedElements() const
+{
+    std::vector<int> rows;
+    rows.reserve(selection_.size());
+    for (CompositeElement* element : selection_) {
+        rows.push_back(rows_.at(element));
+    }
+    return inOrder(rows);
+}
+
+bool ShapeStore::inRect(int row, const QRect& rect, bool inside) const
+{
+    // Сравнение по координатам, а не через QRect: у горизонтальной или
+    // вертикальной линии границы вырождены, и QRect считает их пустыми
+    if (inside) {
+        return left_[row] >= rect.left() && right_[row] <= rect.right() &&
+               top_[row] >= rect.top() && bottom_[row] <= rect.bottom();
+    }
+    return left_[row] <= rect.right() && right_[row] >= rect.left() &&
+           top_[row] <= rect.bottom() && bottom_[row] >= rect.top();
+}
+
+void ShapeStore::write(int row, CompositeElement* element)
+{
+    // Выделение хранится здесь же и из элемента не перечитывается
+    QRect bounds = element->getBorderRect();
+    left_[row] = bounds.left();
+    top_[row] = bounds.top();
+    right_[row] = bounds.right();
+    bottom_[row] = bounds.bottom();
+}
+
+std::vector<CompositeElement*> ShapeStore::inOrder(std::vector<int>& rows) const
+{
+    std::sort(rows.begin(), rows.end(), [this](int a, int b) {
+        return order_[a] < order_[b];
+    });
+
+    std::vector<CompositeElement*> result;
+    result.reserve(rows.size());
+    for (int row : rows) {
+        result.push_back(elements_[row]);
+    }
+    return result;
+}
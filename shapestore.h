@@ -0,0 +1,79 @@
+#ifndef SHAPESTORE_H
+#define SHAPESTORE_H
+
+#include <QRect>
+#include <unordered_map>
+#include <vector>
+
+class CompositeElement;
+
+// Колоночное хранилище сведений об элементах верхнего уровня контейнера.
+// Каждый элемент занимает строку с компактным номером; границы, флаг выделения
+// и z-порядок лежат в параллельных массивах, поэтому массовые запросы
+// (выделение, границы выделенных, точная проверка кандидатов из сетки) идут
+// по непрерывной памяти без виртуальных вызовов. Сами элементы остаются владельцами данных,
+// контейнер обновляет строки при каждом изменении (refresh).
+// При удалении последняя строка переносится на место удаленной, поэтому
+// номера строк не постоянны, а порядок отрисовки хранится в order_.
+//
+// Хранилище владеет выделением элементов верхнего уровня: флаг SelectedFlag
+// в строке служит битовой маской для проверки, а selection_ - списком
+// выделенных, поэтому запросы и снятие выделения стоят O(выделенных).
+// Флаг выделения в самом элементе - только копия для отрисовки.
+class ShapeStore
+{
+public:
+    enum Flag {
+        SelectedFlag = 0x1
+    };
+
+    ShapeStore() = default;
+
+    void insert(CompositeElement* element, quint64 order);
+    void remove(CompositeElement* element);
+    void clear();
+    void reserve(int rows);
+
+    // Перечитывает границы элемента (выделение не меняется)
+    void refresh(CompositeElement* element);
+
+    // Добавляет элемент в выделение или убирает из него; false, если ничего не изменилось
+    bool setSelected(CompositeElement* element, bool selected);
+    void selectAll();
+    void clearSelection();
+    // Выделенные элементы в порядке выделения
+    const std::vector<CompositeElement*>& selection() const { return selection_; }
+
+    int size() const { return (int)elements_.size(); }
+    int rowOf(const CompositeElement* element) const;
+    CompositeElement* elementAt(int row) const { return elements_[row]; }
+    QRect boundsAt(int row) const;
+    bool isSelected(int row) const { return flags_[row] & SelectedFlag; }
+    // Пересекают ли границы строки rect (или лежат ли целиком внутри, если inside)
+    bool inRect(int row, const QRect& rect, bool inside) const;
+
+    // Выделенные элементы в порядке отрисовки
+    std::vector<CompositeElement*> selectedElements() const;
+    int selectedCount() const { return (int)selection_.size(); }
+
+private:
+    std::vector<CompositeElement*> elements_;
+    std::vector<int> left_;
+    std::vector<int> top_;
+    std::vector<int> right_;
+    std::vector<int> bottom_;
+    std::vector<quint8> flags_;
+    std::vector<quint64> order_;
+    std::vector<int> slots_;        // Позиция строки в selection_ или -1
+    std::unordered_map<const CompositeElement*, int> rows_;
+
+    std::vector<CompositeElement*> selection_;
+
+    void select(int row);
+    void deselect(int row);
+
+    void write(int row, CompositeElement* element);
+    std::vector<CompositeElement*> inOrder(std::vector<int>& rows) const;
+};
+
+#endif // SHAPESTORE_H
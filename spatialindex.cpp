@@ -0,0 +1,240 @@
+#include "spatialindex.h"
+#include <algorithm>
+
+SpatialIndex::SpatialIndex(int cellSize) : queryStamp_(0)
+{
+    levels_.resize(LEVEL_COUNT);
+    for (int i = 0; i < LEVEL_COUNT; ++i) {
+        levels_[i].cellSize = cellSize;
+        levels_[i].entries = 0;
+        cellSize *= LEVEL_SCALE;
+    }
+}
+
+void SpatialIndex::insert(CompositeElement* element, const QRect& bounds, quint64 order)
+{
+    if (!element) return;
+
+    if (contains(element)) {
+        remove(element);
+    }
+
+    Entry& entry = entries_[element];
+    entry.element = element;
+    entry.bounds = bounds;
+    entry.order = order;
+    entry.level = -1;
+    entry.stamp = 0;
+    link(&entry);
+}
+
+void SpatialIndex::remove(CompositeElement* element)
+{
+    auto it = entries_.find(element);
+    if (it == entries_.end()) return;
+
+    unlink(&it->second);
+    entries_.erase(it);
+}
+
+void SpatialIndex::update(CompositeElement* element, const QRect& bounds)
+{
+    auto it = entries_.find(element);
+    if (it == entries_.end()) return;
+
+    Entry& entry = it->second;
+    if (entry.bounds == bounds) return;
+
+    // Если уровень и набор ячеек не изменились, достаточно обновить границы
+    int level = levelFor(bounds);
+    if (level >= 0 && level == entry.level) {
+        int cellSize = levels_[level].cellSize;
+        if (cellRange(entry.bounds, cellSize) == cellRange(bounds, cellSize)) {
+            entry.bounds = bounds;
+            return;
+        }
+    }
+
+    unlink(&entry);
+    entry.bounds = bounds;
+    link(&entry);
+}
+
+void SpatialIndex::clear()
+{
+    for (Level& level : levels_) {
+        level.cells.clear();
+        level.entries = 0;
+    }
+    entries_.clear();
+}
+
+bool SpatialIndex::contains(const CompositeElement* element) const
+{
+    return entries_.find(element) != entries_.end();
+}
+
+QRect SpatialIndex::boundsOf(const CompositeElement* element) const
+{
+    auto it = entries_.find(element);
+    if (it == entries_.end()) return QRect();
+    return it->second.bounds;
+}
+
+std::vector<CompositeElement*> SpatialIndex::queryPoint(int x, int y) const
+{
+    std::vector<const Entry*> hits;
+
+    // На каждом уровне точку покрывает ровно одна ячейка, поэтому дублей нет
+    for (const Level& level : levels_) {
+        if (level.entries == 0) continue;
+        auto cell = level.cells.find(cellKey(cellCoord(x, level.cellSize), cellCoord(y, level.cellSize)));
+        if (cell == level.cells.end()) continue;
+        for (const Entry* entry : cell->second) {
+            if (entry->bounds.contains(x, y)) {
+                hits.push_back(entry);
+            }
+        }
+    }
+
+    std::sort(hits.begin(), hits.end(), [](const Entry* a, const Entry* b) {
+        return a->order > b->order;
+    });
+
+    std::vector<CompositeElement*> result;
+    result.reserve(hits.size());
+    for (const Entry* entry : hits) {
+        result.push_back(entry->element);
+    }
+    return result;
+}
+
+std::vector<CompositeElement*> SpatialIndex::queryRect(const QRect& rect) const
+{
+    std::vector<const Entry*> hits;
+    if (rect.isEmpty()) return {};
+
+    quint64 stamp = ++queryStamp_;
+    auto collect = [&](const Entry* entry) {
+        if (entry->stamp != stamp && entry->bounds.intersects(rect)) {
+            entry->stamp = stamp;
+            hits.push_back(entry);
+        }
+    };
+
+    for (const Level& level : levels_) {
+        if (level.entries == 0) continue;
+
+        QRect range = cellRange(rect, level.cellSize);
+        qint64 cellCount = (qint64)range.width() * range.height();
+
+        if (cellCount > (qint64)level.cells.size()) {
+            // Прямоугольник покрывает больше ячеек, чем занято: обходим занятые
+            for (const auto& cell : level.cells) {
+                for (const Entry* entry : cell.second) {
+                    collect(entry);
+                }
+            }
+        } else {
+            for (int cy = range.top(); cy <= range.bottom(); ++cy) {
+                for (int cx = range.left(); cx <= range.right(); ++cx) {
+                    auto cell = level.cells.find(cellKey(cx, cy));
+                    if (cell == level.cells.end()) continue;
+                    for (const Entry* entry : cell->second) {
+                        collect(entry);
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(hits.begin(), hits.end(), [](const Entry* a, const Entry* b) {
+        return a->order < b->order;
+    });
+
+    std::vector<CompositeElement*> result;
+    result.reserve(hits.size());
+    for (const Entry* entry : hits) {
+        result.push_back(entry->element);
+    }
+    return result;
+}
+
+int SpatialIndex::cellCoord(int value, int cellSize)
+{
+    // Деление с округлением вниз, чтобы отрицательные координаты попадали в свои ячейки
+    return value >= 0 ? value / cellSize : -((-value - 1) / cellSize) - 1;
+}
+
+qint64 SpatialIndex::cellKey(int cx, int cy)
+{
+    return ((qint64)cx << 32) | (quint32)cy;
+}
+
+QRect SpatialIndex::cellRange(const QRect& bounds, int cellSize)
+{
+    int left = cellCoord(bounds.left(), cellSize);
+    int top = cellCoord(bounds.top(), cellSize);
+    int right = cellCoord(bounds.right(), cellSize);
+    int bottom = cellCoord(bounds.bottom(), cellSize);
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+int SpatialIndex::levelFor(const QRect& bounds) const
+{
+    // Пустые границы не содержат точек и ничего не пересекают
+    if (bounds.isEmpty()) return -1;
+
+    for (int i = 0; i < LEVEL_COUNT - 1; ++i) {
+        QRect range = cellRange(bounds, levels_[i].cellSize);
+        qint64 cellCount = (qint64)range.width() * range.height();
+        if (cellCount <= MAX_CELLS_PER_ENTRY) {
+            return i;
+        }
+    }
+    return LEVEL_COUNT - 1;
+}
+
+void SpatialIndex::link(Entry* entry)
+{
+    entry->level = levelFor(entry->bounds);
+    if (entry->level < 0) return;
+
+    Level& level = levels_[entry->level];
+    ++level.entries;
+    QRect range = cellRange(entry->bounds, level.cellSize);
+    for (int cy = range.top(); cy <= range.bottom(); ++cy) {
+        for (int cx = range.left(); cx <= range.right(); ++cx) {
+            level.cells[cellKey(cx, cy)].push_back(entry);
+        }
+    }
+}
+
+void SpatialIndex::unlink(Entry* entry)
+{
+    if (entry->level < 0) return;
+
+    Level& level = levels_[entry->level];
+    --level.entries;
+    QRect range = cellRange(entry->bounds, level.cellSize);
+    for (int cy = range.top(); cy <= range.bottom(); ++cy) {
+        for (int cx = range.left(); cx <= range.right(); ++cx) {
+            auto cell = level.cells.find(cellKey(cx, cy));
+            if (cell == level.cells.end()) continue;
+            eraseFrom(cell->second, entry);
+            if (cell->second.empty()) {
+                level.cells.erase(cell);
+            }
+        }
+    }
+    entry->level = -1;
+}
+
+void SpatialIndex::eraseFrom(std::vector<Entry*>& list, Entry* entry)
+{
+    auto it = std::find(list.begin(), list.end(), entry);
+    if (it != list.end()) {
+        *it = list.back();
+        list.pop_back();
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QRect>
+#include <unordered_map>
+#include <vector>
+
+class CompositeElement;
+
+// Иерархическая сетка для быстрого поиска элементов по точке и прямоугольнику.
+// Уровни - равномерные сетки, у каждого следующего ячейка в LEVEL_SCALE раз
+// крупнее. Элемент хранится на самом мелком уровне, где покрывает не больше
+// MAX_CELLS_PER_ENTRY ячеек, в ячейках, которые покрывают его границы, вместе
+// с порядковым номером, чтобы результаты можно было вернуть в z-порядке.
+// Длинные стрелки и большие группы уходят на крупные уровни, поэтому запрос
+// смотрит по несколько ячеек на уровень, а не перебирает все большие элементы.
+class SpatialIndex
+{
+public:
+    explicit SpatialIndex(int cellSize = 128);
+
+    void insert(CompositeElement* element, const QRect& bounds, quint64 order);
+    void remove(CompositeElement* element);
+    void update(CompositeElement* element, const QRect& bounds);
+    void clear();
+
+    bool contains(const CompositeElement* element) const;
+    QRect boundsOf(const CompositeElement* element) const;
+    int size() const { return (int)entries_.size(); }
+
+    // Кандидаты, чьи границы содержат точку: сверху вниз (последний добавленный первым)
+    std::vector<CompositeElement*> queryPoint(int x, int y) const;
+
+    // Кандидаты, чьи границы пересекают прямоугольник: в порядке отрисовки
+    std::vector<CompositeElement*> queryRect(const QRect& rect) const;
+
+private:
+    struct Entry {
+        CompositeElement* element;
+        QRect bounds;
+        quint64 order;
+        int level;                 // Уровень сетки или -1 для пустых границ
+        mutable quint64 stamp;     // Метка последнего запроса для исключения дублей
+    };
+
+    struct Level {
+        int cellSize;
+        int entries;
+        std::unordered_map<qint64, std::vector<Entry*>> cells;
+    };
+
+    // Элементы, покрывающие больше ячеек, чем это значение, уходят на уровень выше
+    static const int MAX_CELLS_PER_ENTRY = 64;
+    // Во сколько раз ячейка уровня крупнее ячейки предыдущего
+    static const int LEVEL_SCALE = 4;
+    static const int LEVEL_COUNT = 8;
+
+    std::unordered_map<const CompositeElement*, Entry> entries_;
+    std::vector<Level> levels_;
+    mutable quint64 queryStamp_;
+
+    static int cellCoord(int value, int cellSize);
+    static qint64 cellKey(int cx, int cy);
+    static QRect cellRange(const QRect& bounds, int cellSize);
+    int levelFor(const QRect& bounds) const;
+
+    void link(Entry* entry);
+    void unlink(Entry* entry);
+    static void eraseFrom(std::vector<Entry*>& list, Entry* entry);
+};
+
+#endif // SPATIALINDEX_H
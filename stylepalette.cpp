@@ -0,0 +1,120 @@
+#include "stylepalette.h"
+
+thread_local StylePalette* StylePalette::current_ = nullptr;
+
+StylePalette& StylePalette::shared()
+{
+    static StylePalette palette;
+    return palette;
+}
+
+const ShapeStyle* StylePalette::intern(QRgb color, const StyleKey& normal, const StyleKey& selected)
+{
+    PairKey key{ color, normal, selected };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::unique_ptr<StylePair>& pair = styles_[key];
+    if (!pair) {
+        pair.reset(new StylePair);
+        fill(*pair, key);
+    }
+    return &pair->normal;
+}
+
+bool StylePalette::recolor(QRgb from, QRgb to)
+{
+    if (from == to) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::unique_ptr<StylePair>> recolored;
+    std::vector<PairKey> keys;
+    for (auto it = styles_.begin(); it != styles_.end(); ) {
+        if (it->first.color == from) {
+            keys.push_back(it->first);
+            recolored.push_back(std::move(it->second));
+            it = styles_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (size_t i = 0; i < recolored.size(); ++i) {
+        PairKey key = keys[i];
+        key.color = to;
+        fill(*recolored[i], key);
+
+        std::unique_ptr<StylePair>& slot = styles_[key];
+        if (!slot) {
+            slot = std::move(recolored[i]);
+        } else {
+            merged_.push_back(std::move(recolored[i]));
+        }
+    }
+    return !keys.empty();
+}
+
+void StylePalette::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    styles_.clear();
+    merged_.clear();
+}
+
+int StylePalette::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (int)styles_.size();
+}
+
+void StylePalette::fill(StylePair& pair, const PairKey& key)
+{
+    build(pair.normal, key.normal, key.color);
+    build(pair.selected, key.selected, key.color);
+    for (ShapeStyle* style : { &pair.normal, &pair.selected }) {
+        style->color = key.color;
+        style->palette = this;
+        style->normal = &pair.normal;
+        style->selected = &pair.selected;
+    }
+}
+
+void StylePalette::build(ShapeStyle& style, const StyleKey& key, QRgb color)
+{
+    QRgb penColor = resolve(key.penRole, key.penColor, color);
+    style.pen = QPen(QColor::fromRgba(penColor), key.penWidth, (Qt::PenStyle)key.penStyle);
+    if (key.filled) {
+        style.brush = QBrush(QColor::fromRgba(resolve(key.fillRole, key.fillColor, color)));
+    } else {
+        style.brush = QBrush(Qt::NoBrush);
+    }
+}
+
+QRgb StylePalette::resolve(ColorRole role, QRgb fixed, QRgb color)
+{
+    switch (role) {
+    case ColorRole::Shape:
+        return color;
+    case ColorRole::LighterShape:
+        return QColor::fromRgba(color).lighter(150).rgba();
+    case ColorRole::Fixed:
+        break;
+    }
+    return fixed;
+}
+
+size_t StylePalette::KeyHash::operator()(const StyleKey& key) const
+{
+    quint64 colors = ((quint64)key.penColor << 32) | key.fillColor;
+    quint64 rest = ((quint64)key.penWidth << 16) | ((quint64)key.penStyle << 8) | key.filled;
+    rest |= ((quint64)key.penRole << 24) | ((quint64)key.fillRole << 32);
+    return std::hash<quint64>()(colors * 0x9E3779B97F4A7C15ULL ^ rest);
+}
+
+size_t StylePalette::KeyHash::operator()(const PairKey& key) const
+{
+    size_t hash = (*this)(key.normal);
+    hash ^= (*this)(key.selected) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    return hash ^ std::hash<quint32>()(key.color);
+}
@@ -0,0 +1,156 @@
+#ifndef STYLEPALETTE_H
+#define STYLEPALETTE_H
+
+#include <QPen>
+#include <QBrush>
+#include <QColor>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Откуда берется цвет пера или заливки
+enum class ColorRole : quint8 {
+    Fixed,           // Цвет задан в описании
+    Shape,           // Цвет фигуры
+    LighterShape     // Осветленный цвет фигуры (заливка выделенной)
+};
+
+// Описание оформления фигуры: цвет и толщина пера, цвет заливки. Цвет
+// фигуры в описание не входит, поэтому палитра может перекрасить запись,
+// не спрашивая фигуру.
+struct StyleKey
+{
+    QRgb penColor;
+    QRgb fillColor;
+    quint16 penWidth;
+    quint8 penStyle;   // Qt::PenStyle
+    quint8 filled;     // 0 - без заливки
+    ColorRole penRole;
+    ColorRole fillRole;
+
+    bool operator==(const StyleKey& other) const {
+        return penColor == other.penColor && fillColor == other.fillColor &&
+               penWidth == other.penWidth && penStyle == other.penStyle &&
+               filled == other.filled && penRole == other.penRole &&
+               fillRole == other.fillRole;
+    }
+
+    // Перо заданного цвета, заливка цветом фигуры
+    static StyleKey outline(QRgb penColor, int penWidth, ColorRole fill) {
+        return StyleKey{ penColor, 0, (quint16)penWidth, (quint8)Qt::SolidLine, 1, ColorRole::Fixed, fill };
+    }
+
+    static StyleKey stroke(QRgb penColor, int penWidth) {
+        return StyleKey{ penColor, 0, (quint16)penWidth, (quint8)Qt::SolidLine, 0, ColorRole::Fixed, ColorRole::Fixed };
+    }
+
+    // Перо цветом фигуры
+    static StyleKey stroke(ColorRole pen, int penWidth) {
+        return StyleKey{ 0, 0, (quint16)penWidth, (quint8)Qt::SolidLine, 0, pen, ColorRole::Fixed };
+    }
+};
+
+class StylePalette;
+
+// Готовые перо и кисть одного оформления. Запись меняется только при
+// перекраске палитры в потоке документа, поэтому во время отрисовки ее
+// можно читать из любого потока без блокировки.
+// Записи создаются парами: обычное оформление фигуры и выделенное. Обе
+// знают цвет фигуры, свою палитру и друг друга, поэтому фигуре хватает
+// одного указателя, а смена выделения - просто переход к соседней записи.
+struct ShapeStyle
+{
+    QPen pen;
+    QBrush brush;
+
+    QRgb color;                  // Цвет фигуры, для которой построена пара
+    StylePalette* palette;
+    const ShapeStyle* normal;
+    const ShapeStyle* selected;
+};
+
+// Палитра оформлений документа. В документах используется всего несколько
+// цветов, поэтому фигуры хранят только указатель на запись палитры, а перо
+// и кисть создаются один раз на запись, а не для каждой фигуры.
+//
+// Палитрой владеет документ (ShapeContainer). Фигуры, созданные внутри
+// Scope, берут записи из палитры документа; остальные - из общей палитры
+// shared(), а при добавлении в документ переходят в его палитру. Записи
+// живут, пока их не освободит clear() - документ вызывает его, когда
+// удалил все свои фигуры.
+class StylePalette
+{
+public:
+    StylePalette() = default;
+
+    StylePalette(const StylePalette&) = delete;
+    StylePalette& operator=(const StylePalette&) = delete;
+
+    // Палитра для фигур, созданных вне документа
+    static StylePalette& shared();
+    // Палитра, из которой сейчас берут записи новые фигуры этого потока
+    static StylePalette& current() { return current_ ? *current_ : shared(); }
+
+    class Scope
+    {
+    public:
+        explicit Scope(StylePalette* palette) : previous_(current_) { current_ = palette; }
+        ~Scope() { current_ = previous_; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StylePalette* previous_;
+    };
+
+    // Обычная запись пары для цвета фигуры; пара создается при первом запросе
+    const ShapeStyle* intern(QRgb color, const StyleKey& normal, const StyleKey& selected);
+
+    // Перекрашивает все пары цвета from в цвет to на месте: фигуры, которые
+    // на них ссылаются, меняют цвет без обхода. false, если таких пар нет
+    bool recolor(QRgb from, QRgb to);
+
+    // Освобождает все записи. Вызывать, когда на них не ссылается ни одна фигура
+    void clear();
+
+    int size() const;
+
+private:
+
+    struct PairKey {
+        QRgb color;
+        StyleKey normal;
+        StyleKey selected;
+
+        bool operator==(const PairKey& other) const {
+            return color == other.color && normal == other.normal && selected == other.selected;
+        }
+    };
+
+    struct StylePair {
+        ShapeStyle normal;
+        ShapeStyle selected;
+    };
+
+    struct KeyHash {
+        size_t operator()(const StyleKey& key) const;
+        size_t operator()(const PairKey& key) const;
+    };
+
+    static void build(ShapeStyle& style, const StyleKey& key, QRgb color);
+    static QRgb resolve(ColorRole role, QRgb fixed, QRgb color);
+    void fill(StylePair& pair, const PairKey& key);
+
+    // Общей палитрой пользуются фигуры из любых потоков
+    mutable std::mutex mutex_;
+    std::unordered_map<PairKey, std::unique_ptr<StylePair>, KeyHash> styles_;
+    // Пары, которые после перекраски совпали с уже имевшимися: на них еще
+    // ссылаются фигуры, поэтому они живут до clear()
+    std::vector<std::unique_ptr<StylePair>> merged_;
+
+    static thread_local StylePalette* current_;
+};
+
+#endif // STYLEPALETTE_H
@@ -0,0 +1,95 @@
+#include "tiledrenderer.h"
+#include "shapecontainer.h"
+#include "renderbatch.h"
+#include "arrow.h"
+#include "group.h"
+#include "viewport.h"
+#include <QPainter>
+#include <QThread>
+#include <QtMath>
+#include <algorithm>
+
+TiledRenderer::TiledRenderer(int tileSize) : tileSize_(tileSize)
+{
+    pool_.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+TiledRenderer::~TiledRenderer()
+{
+    pool_.waitForDone();
+}
+
+void TiledRenderer::render(const ShapeContainer& shapes, const Viewport& viewport,
+                           QImage& image, bool skipSelectionLayer)
+{
+    qreal ratio = image.devicePixelRatio();
+    int width = qCeil(image.width() / ratio);
+    int height = qCeil(image.height() / ratio);
+
+    // Раскладываем фигуры по плиткам в потоке GUI
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += tileSize_) {
+        for (int x = 0; x < width; x += tileSize_) {
+            Tile tile;
+            tile.rect = QRect(x, y, std::min(tileSize_, width - x), std::min(tileSize_, height - y));
+            QRect worldRect = viewport.mapToWorld(tile.rect);
+            tile.worldRect = worldRect;
+
+            for (CompositeElement* element : shapes.findElementsInRect(worldRect)) {
+                if (!skipSelectionLayer || !shapes.isInSelectionLayer(element)) {
+                    // Иерархию группы строим здесь: в плитках она только читается
+                    if (element->isGroup()) {
+                        static_cast<Group*>(element)->prepareHierarchy();
+                    }
+                    tile.elements.push_back(element);
+                }
+            }
+            for (Arrow* arrow : shapes.findArrowsInRect(worldRect)) {
+                if (!skipSelectionLayer || !shapes.isInSelectionLayer(arrow)) {
+                    tile.arrows.push_back(arrow);
+                }
+            }
+
+            // Пустые плитки не нужно отправлять в пул
+            if (!tile.elements.empty() || !tile.arrows.empty()) {
+                tiles.push_back(std::move(tile));
+            }
+        }
+    }
+
+    QTransform transform = viewport.transform();
+    qreal zoom = viewport.zoom();
+    for (Tile& tile : tiles) {
+        Tile* job = &tile;
+        pool_.start([job, transform, zoom, ratio]() { renderTile(*job, transform, zoom, ratio); });
+    }
+    pool_.waitForDone();
+
+    QPainter painter(&image);
+    for (const Tile& tile : tiles) {
+        painter.drawImage(tile.rect.topLeft(), tile.image);
+    }
+}
+
+void TiledRenderer::renderTile(Tile& tile, const QTransform& transform, qreal zoom, qreal ratio)
+{
+    QSize pixelSize(qCeil(tile.rect.width() * ratio), qCeil(tile.rect.height() * ratio));
+    tile.image = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+    tile.image.setDevicePixelRatio(ratio);
+    tile.image.fill(Qt::transparent);
+
+    QPainter painter(&tile.image);
+    painter.translate(-tile.rect.topLeft());
+    painter.setTransform(transform, true);
+
+    RenderBatch batch;
+    batch.setDetailScale(zoom);
+    batch.setCullRect(tile.worldRect);
+    for (CompositeElement* element : tile.elements) {
+        element->addToBatch(batch);
+    }
+    for (Arrow* arrow : tile.arrows) {
+        arrow->addToBatch(batch);
+    }
+    batch.flush(painter);
+}
@@ -0,0 +1,51 @@
+#ifndef TILEDRENDERER_H
+#define TILEDRENDERER_H
+
+#include <QImage>
+#include <QRect>
+#include <QThreadPool>
+#include <QTransform>
+#include <vector>
+
+class ShapeContainer;
+class Viewport;
+class CompositeElement;
+class Arrow;
+
+// Многопоточная растеризация рабочей области по плиткам.
+// Область делится на плитки, каждая плитка рисуется своим QPainter в свой
+// QImage в пуле потоков, а затем плитки переносятся в итоговое изображение
+// в потоке GUI. Списки фигур для плиток собираются заранее в потоке GUI,
+// поэтому рабочие потоки только читают фигуры и ничего в них не меняют.
+class TiledRenderer
+{
+public:
+    explicit TiledRenderer(int tileSize = 256);
+    ~TiledRenderer();
+
+    // Рисует видимую через viewport часть контейнера в image (его логический
+    // размер задает область). Если skipSelectionLayer, выделенные фигуры и их
+    // стрелки пропускаются.
+    void render(const ShapeContainer& shapes, const Viewport& viewport,
+                QImage& image, bool skipSelectionLayer);
+
+    int tileSize() const { return tileSize_; }
+    void setTileSize(int tileSize) { tileSize_ = tileSize; }
+    int threadCount() const { return pool_.maxThreadCount(); }
+
+private:
+    struct Tile {
+        QRect rect;
+        QRect worldRect;  // Та же плитка в мировых координатах, для отсечения детей групп
+        std::vector<CompositeElement*> elements;
+        std::vector<Arrow*> arrows;
+        QImage image;
+    };
+
+    int tileSize_;
+    QThreadPool pool_;
+
+    static void renderTile(Tile& tile, const QTransform& transform, qreal zoom, qreal ratio);
+};
+
+#endif // TILEDRENDERER_H
@@ -1,29 +1,48 @@
 #include "triangle.h"
+#include "renderbatch.h"
+#include "hittest.h"
 
-Triangle::Triangle(int x, int y, int size) : Shape(x, y), size_(size) {}
+Triangle::Triangle(int x, int y, int size) : Shape(x, y), size_(size) {
+    updateRenderCache();
+}
 
 bool Triangle::contains(int x, int y) const {
-    QRect bounds = getBorderRect().adjusted(-5, -5, 5, 5);
-    return bounds.contains(x, y);
+    return HitTest::inTriangle(x, y,
+                               vertices_[0].x(), vertices_[0].y(),
+                               vertices_[1].x(), vertices_[1].y(),
+                               vertices_[2].x(), vertices_[2].y());
 }
 
 void Triangle::draw(QPainter &painter) const {
-    if (selected_) {
-        painter.setPen(QPen(Qt::blue, 2));
-        painter.setBrush(color_.lighter(150));
-    }
-    else {
-        painter.setPen(QPen(Qt::black, 1));
-        painter.setBrush(color_);
-    }
+    painter.setPen(style_->pen);
+    painter.setBrush(style_->brush);
 
-    QPoint points[3] = {
-        QPoint(x_, y_ + size_ / 2),
-        QPoint(x_ + size_, y_ + size_ / 2),
-        QPoint(x_ + size_ / 2, y_ - size_ / 2)
-    };
+    painter.drawPolygon(polygon());
+}
+
+void Triangle::addToBatch(RenderBatch &batch) const {
+    batch.addPolygon(polygon(), style_->pen, style_->brush);
+}
 
-    painter.drawPolygon(points, 3);
+void Triangle::addToHitTest(HitTestBatch &batch, int id) const {
+    batch.addTriangle(id,
+                      vertices_[0].x(), vertices_[0].y(),
+                      vertices_[1].x(), vertices_[1].y(),
+                      vertices_[2].x(), vertices_[2].y());
+}
+
+void Triangle::updateGeometry() {
+    vertices_ = { QPoint(x_, y_ + size_ / 2),
+                  QPoint(x_ + size_, y_ + size_ / 2),
+                  QPoint(x_ + size_ / 2, y_ - size_ / 2) };
+}
+
+QPolygon Triangle::polygon() const {
+    QPolygon polygon(3);
+    for (int i = 0; i < 3; ++i) {
+        polygon.setPoint(i, vertices_[i]);
+    }
+    return polygon;
 }
 
 QRect Triangle::getBorderRect() const {
@@ -36,4 +55,5 @@ int Triangle::getSize() const {
 
 void Triangle::setSize(int size) {
     size_ = size;
+    updateGeometry();
 }
@@ -2,21 +2,34 @@
 #define TRIANGLE_H
 
 #include "shape.h"
+#include <QPolygon>
+#include <array>
 
 class Triangle : public Shape
 {
 private:
     int size_;
+    // Вершины хранятся прямо в фигуре, без отдельного выделения памяти;
+    // пересчитываются при перемещении и изменении размера
+    std::array<QPoint, 3> vertices_;
+
+    // Многоугольник для рисования собирается из вершин по запросу
+    QPolygon polygon() const;
 
 public:
     Triangle(int x, int y, int size = 40);
 
     void draw(QPainter &painter) const override;
+    void addToBatch(RenderBatch &batch) const override;
+    void addToHitTest(HitTestBatch &batch, int id) const override;
     bool contains(int x, int y) const override;
     QRect getBorderRect() const override;
 
     int getSize() const;
     void setSize(int size);
+
+protected:
+    void updateGeometry() override;
 };
 
 #endif // TRIANGLE_H
@@ -0,0 +1,76 @@
+#include "viewport.h"
+#include <QtMath>
+
+Viewport::Viewport() : zoom_(1.0), offset_(0, 0) {}
+
+void Viewport::zoomAt(qreal factor, const QPointF& screenAnchor)
+{
+    qreal newZoom = qBound(MIN_ZOOM, zoom_ * factor, MAX_ZOOM);
+    if (newZoom == zoom_) return;
+
+    // Точка мира под якорем должна остаться под ним после масштабирования
+    QPointF world = mapToWorld(screenAnchor);
+    zoom_ = newZoom;
+    offset_ = screenAnchor - world * zoom_;
+}
+
+void Viewport::panBy(const QPointF& screenDelta)
+{
+    offset_ += screenDelta;
+}
+
+void Viewport::reset()
+{
+    zoom_ = 1.0;
+    offset_ = QPointF(0, 0);
+}
+
+void Viewport::fitTo(const QRect& world, const QSize& screen, int margin)
+{
+    qreal width = screen.width() - 2 * margin;
+    qreal height = screen.height() - 2 * margin;
+    if (world.isEmpty() || width <= 0 || height <= 0) {
+        reset();
+        return;
+    }
+
+    zoom_ = qBound(MIN_ZOOM, qMin(width / world.width(), height / world.height()), MAX_ZOOM);
+
+    // Центрируем содержимое в области экрана
+    QPointF center(world.left() + world.width() / 2.0, world.top() + world.height() / 2.0);
+    offset_ = QPointF(screen.width() / 2.0, screen.height() / 2.0) - center * zoom_;
+}
+
+QTransform Viewport::transform() const
+{
+    return QTransform(zoom_, 0, 0, zoom_, offset_.x(), offset_.y());
+}
+
+QPointF Viewport::mapToWorld(const QPointF& screen) const
+{
+    return (screen - offset_) / zoom_;
+}
+
+QPoint Viewport::mapToWorld(const QPoint& screen) const
+{
+    QPointF world = mapToWorld(QPointF(screen));
+    return QPoint(qFloor(world.x()), qFloor(world.y()));
+}
+
+QRect Viewport::mapToWorld(const QRect& screen) const
+{
+    QPointF topLeft = mapToWorld(QPointF(screen.left(), screen.top()));
+    QPointF bottomRight = mapToWorld(QPointF(screen.left() + screen.width(), screen.top() + screen.height()));
+    return QRect(QPoint(qFloor(topLeft.x()), qFloor(topLeft.y())),
+                 QPoint(qCeil(bottomRight.x()), qCeil(bottomRight.y())));
+}
+
+QRect Viewport::mapToScreen(const QRect& world) const
+{
+    qreal left = world.left() * zoom_ + offset_.x();
+    qreal top = world.top() * zoom_ + offset_.y();
+    qreal right = (world.left() + world.width()) * zoom_ + offset_.x();
+    qreal bottom = (world.top() + world.height()) * zoom_ + offset_.y();
+    return QRect(QPoint(qFloor(left), qFloor(top)),
+                 QPoint(qCeil(right), qCeil(bottom)));
+}
@@ -0,0 +1,46 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include <QPointF>
+#include <QRect>
+#include <QSize>
+#include <QTransform>
+
+// Преобразование между мировыми координатами документа и экранными
+// координатами рабочей области: screen = world * zoom + offset.
+class Viewport
+{
+public:
+    // Размер мира, в пределах которого можно создавать и двигать фигуры
+    static const int WORLD_SIZE = 100000;
+    static constexpr qreal MIN_ZOOM = 0.02;
+    static constexpr qreal MAX_ZOOM = 16.0;
+
+    Viewport();
+
+    qreal zoom() const { return zoom_; }
+    QPointF offset() const { return offset_; }
+
+    // Масштабирование вокруг точки экрана (точка под курсором остается на месте)
+    void zoomAt(qreal factor, const QPointF& screenAnchor);
+    void panBy(const QPointF& screenDelta);
+    void reset();
+
+    // Подбирает масштаб и смещение так, чтобы world целиком поместился в screen
+    void fitTo(const QRect& world, const QSize& screen, int margin = 0);
+
+    QTransform transform() const;
+
+    QPointF mapToWorld(const QPointF& screen) const;
+    QPoint mapToWorld(const QPoint& screen) const;
+    QRect mapToWorld(const QRect& screen) const;
+    QRect mapToScreen(const QRect& world) const;
+
+    static QRect worldRect() { return QRect(0, 0, WORLD_SIZE, WORLD_SIZE); }
+
+private:
+    qreal zoom_;
+    QPointF offset_;
+};
+
+#endif // VIEWPORT_H